@@ -1,4 +1,6 @@
+#include "liver/chunked_vessel_tree.hpp"
 #include "liver/fill_liver_volume.hpp"
+#include "liver/tract_lattice.hpp"
 #include "liver/physical_vessel.hpp"
 #include "liver/physical_vessel_tree_updater.hpp"
 #include "messages/vessel_tree.pb.h"
@@ -6,7 +8,6 @@
 #include "utility/binary_tree.hpp"
 #include "utility/git_hash.hpp"
 #include "utility/options.hpp"
-#include "utility/protobuf_zip_ostream.hpp"
 #include <boost/filesystem.hpp>
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
@@ -35,7 +36,8 @@ int main(int argc, char* argv[]) {
 
     auto liver = voxelized_shape{opts.data_directory() / "liver_extents.datz", adjust::do_open};
     auto full_start = std::chrono::high_resolution_clock::now();
-    auto tracts = tracts_in(liver) | ranges::view::transform([](m3 pt) { return node{pt, {}}; }) | ranges::to_vector;
+    auto tract_pts = tract_lattice{liver};
+    auto tracts = tract_pts.points() | ranges::view::transform([](m3 pt) { return node{pt, {}}; }) | ranges::to_vector;
     auto num_levels = std::ceil(std::log2(tracts.size())) + 1;
     auto levels = std::vector<std::vector<node>>(num_levels);
     levels.back() = std::move(tracts);
@@ -79,8 +81,7 @@ int main(int argc, char* argv[]) {
     auto p = opts.output_path() / "run_50_50";
     fs::create_directories(p);
 
-    protobuf_zip_ostream out_stream{p / "fifty_tree.pbz"};
-    jhmi_message::VesselTree vt;
+    chunked_tree_writer vt{p / "fifty_tree.pbz"};
     RANGES_FOR(auto&& n, vessels | view::node_level_order) {
       auto p = n.parent();
       auto r = n.right_child();
@@ -104,8 +105,7 @@ int main(int argc, char* argv[]) {
       vtv->set_ez(v.end().z.value());
       vtv->set_is_const(false);
     }
-    if (!vt.SerializeToZeroCopyStream(out_stream.get()))
-      throw std::runtime_error("Failed to write 50/50 tree.");
+    vt.close();
 
     auto full_stop = std::chrono::high_resolution_clock::now();
     fmt::print("Done in {} s!\n",
@@ -8,6 +8,7 @@
 #include <fmt/ostream.h>
 #include <chrono>
 #include <iostream>
+#include <memory>
 #include <random>
 
 using namespace jhmi;
@@ -20,27 +21,60 @@ int main(int argc, char* argv[]) {
     auto opts = options<data_directory_option, seed_option, output_path_option>{};
     int cycles = 0;
     m final_radius;
-    double flow_ml_min, gamma, cell_pressure_mmHg;
+    double flow_ml_min, gamma, cell_pressure_mmHg, validate_fraction;
+    auto validate_policy = validation::full;
+    bool parallel_growth = false;
+    bool resume = false;
+    bool delta_snapshots = false;
+    auto cost = connection_cost::sampled;
     opts.description().add_options()
       ("cycles", po::value(&cycles)->default_value(15), "Number of growth/death cycles")
       ("final-radius", unit_value(&final_radius, 1e-3)->default_value(.5), "Final radius in millimeters")
       ("proper-flow", po::value(&flow_ml_min)->default_value(400), "Flow through the proper hepatic artery in mL / min")
       ("gamma", po::value(&gamma)->default_value(2.7), "Murray's bifurcation constant (2-3)")
-      ("cell-pressure", po::value(&cell_pressure_mmHg)->default_value(25), "Pressure at macrocells");
+      ("cell-pressure", po::value(&cell_pressure_mmHg)->default_value(25), "Pressure at macrocells")
+      ("validate", po::value(&validate_policy)->default_value(validation::full, "full"), "Tree checks after each cycle: off, sampled or full")
+      ("validate-fraction", po::value(&validate_fraction)->default_value(.05), "Fraction of the tree checked each cycle when sampled")
+      ("parallel-growth", po::bool_switch(&parallel_growth), "Place new macrocells in parallel (deterministic, but differs from a serial build)")
+      ("connection-cost", po::value(&cost)->default_value(connection_cost::sampled, "sampled"), "How new macrocells pick a vessel: sampled, or (experimental, and slower by an unmeasured factor) the least added volume or power")
+      ("delta-snapshots", po::bool_switch(&delta_snapshots), "Write each cycle's snapshot after the first as only its changes from the one before")
+      ("resume", po::bool_switch(&resume), "Continue the interrupted build of this seed from its last checkpoint (flow, gamma, cell pressure, parallel growth and connection cost are taken from it)");
     if (!opts.parse(argc, argv))
       return 1;
 
     auto vesselfile = opts.data_directory() / "vtree_cycle0.txt";
     auto liver = voxelized_shape{opts.data_directory() / "liver_extents.datz", adjust::do_open};
+    auto p = opts.output_path() / fmt::format("run_{}", opts.seed());
+    auto checkpoint = p / "build_checkpoint.pbz";
     auto full_start = std::chrono::high_resolution_clock::now();
-    auto tree = macrocell_tree{build_tree, vesselfile, liver, opts.seed(), cubic_meters_per_second{flow_ml_min * mL / minutes}, gamma, Pa{cell_pressure_mmHg * mmHg}, true /*initial_fill*/};
+    auto tree = resume
+      ? std::make_unique<macrocell_tree>(resume_build, checkpoint, liver)
+      : std::make_unique<macrocell_tree>(build_tree, vesselfile, liver, opts.seed(), cubic_meters_per_second{flow_ml_min * mL / minutes}, gamma, Pa{cell_pressure_mmHg * mmHg}, true /*initial_fill*/);
+
+    tree->set_validation(validate_policy, validate_fraction);
+    if (resume) {
+      //The settings that shape the tree come from the checkpoint; asking for
+      // others would silently build a different tree.
+      auto const& vm = opts.variables();
+      if (!vm["parallel-growth"].defaulted() && parallel_growth != tree->parallel_growth())
+        throw std::runtime_error("--parallel-growth doesn't match the checkpoint's setting");
+      if (!vm["connection-cost"].defaulted() && cost != tree->current_connection_cost())
+        throw std::runtime_error(fmt::format("--connection-cost {} doesn't match the checkpoint's {}",
+          cost, tree->current_connection_cost()));
+    }
+    else {
+      tree->set_parallel_growth(parallel_growth);
+      tree->set_connection_cost(cost);
+    }
+    tree->set_checkpoint(checkpoint);
+    tree->set_delta_snapshots(delta_snapshots);
 
-    auto p = opts.output_path() / fmt::format("run_{}", opts.seed());
     fs::create_directories(p);
-    tree.build(cycles, final_radius, p, "vessel_tree.{:02}.pbz");
+    tree->build(cycles, final_radius, p, "vessel_tree.{:02}.pbz");
+    remove_build_checkpoint(checkpoint);
 
-    tree.write(p / "vessel_tree.pbz");
-    auto ts = calc_tree_stats(tree, liver);
+    tree->write(p / "vessel_tree.pbz");
+    auto ts = calc_tree_stats(*tree, liver);
     write_tree_stats(ts, p);
 
     auto f = std::ofstream{(p / "build_parameters.txt").string()};
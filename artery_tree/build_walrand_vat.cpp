@@ -1,8 +1,10 @@
 
 #include "liver/fill_liver_volume.hpp"
+#include "liver/tract_lattice.hpp"
 #include "liver/walrand_tree.hpp"
 #include "utility/git_hash.hpp"
 #include "utility/options.hpp"
+#include "utility/philox.hpp"
 #include <boost/filesystem.hpp>
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
@@ -21,12 +23,12 @@ int main(int argc, char* argv[]) {
     auto opts = options<shapefile_option, vesselfile_option, seed_option, output_path_option>{};
     if (!opts.parse(argc, argv))
       return 1;
-    auto eng = std::mt19937{opts.seed()};
+    auto eng = philox4x32{opts.seed()};
 
     auto full_start = std::chrono::high_resolution_clock::now();
     //First, generate the locations of the portal tracts.
     auto liver = voxelized_shape{opts.shapefile(), adjust::do_open};
-    auto pts = tracts_in(liver) | ranges::to_vector;
+    auto pts = tract_lattice{liver}.points() | ranges::to_vector;
     //Next, load the initial vessel tree
     auto vtree = walrand_tree{build_tree, opts.vesselfile().string(), liver};
     //Shuffle the locations randomly
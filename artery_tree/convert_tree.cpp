@@ -0,0 +1,38 @@
+#include "liver/chunked_vessel_tree.hpp"
+#include "liver/columnar_tree.hpp"
+#include "liver/tree_snapshots.hpp"
+#include "utility/options.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+
+using namespace jhmi;
+namespace po = boost::program_options;
+
+//Converts a vessel tree between the VesselTree protobuf formats (chunked, a
+// single message, or a delta snapshot) and the columnar one, in whichever
+// direction the input calls for.  Columnar trees are converted to chunked
+// files.
+int main(int argc, char* argv[]) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  try {
+    auto opts = options<treefile_option>{};
+    std::string output;
+    opts.description().add_options()
+      ("output,o", po::value(&output)->required(), "File to write the converted tree to");
+    if (!opts.parse(argc, argv))
+      return 1;
+    if (is_columnar_tree(opts.treefile())) {
+      write_chunked_vessel_tree(to_vessel_tree(columnar_tree{opts.treefile()}), output);
+    }
+    else {
+      write_columnar_tree(load_snapshot(opts.treefile()), output);
+    }
+    google::protobuf::ShutdownProtobufLibrary();
+  }
+  catch (std::exception const& e) {
+    fmt::print("Failed with exception: {}\n", e.what());
+    return 1;
+  }
+  return 0;
+}
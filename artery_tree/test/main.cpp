@@ -1,6 +1,9 @@
 #include "liver/macrocell_tree.hpp"
 #include "utility/volume_image.hpp"
 #include <boost/filesystem.hpp>
+#include <tbb/global_control.h>
+#include <algorithm>
+#include <memory>
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
@@ -14,12 +17,214 @@ TEST_CASE( "Storing and loading", "[macrocell_tree]" ) {
     const int cycles = 15;
     auto final_radius = 7_mm;
     auto tree = macrocell_tree{build_tree, initial_vessels, liver, seed, cubic_meters_per_second{400. * mL / minutes}, 2.7, 25_mmHg, true /*use_lattice*/};
+    tree.verify_normalize(true);
     tree.build(cycles, final_radius);
     REQUIRE(tree.validate());
+    REQUIRE(tree.validate(.1, 1));
     auto saved_file = boost::filesystem::current_path() / "vessel_tree.pbz";
     tree.write(saved_file);
 
     auto tree2 = macrocell_tree{load_tree, saved_file};
     REQUIRE(tree == tree2);
+    //Hashes kept up through the build match those of the tree as loaded.
+    REQUIRE(tree.vessel_tree().hashes_current());
+    REQUIRE(tree.vessel_tree().hashes().root() == tree2.vessel_tree().hashes().root());
+
+    auto columnar_file = boost::filesystem::current_path() / "vessel_tree.col";
+    tree.write_columnar(columnar_file);
+    auto tree3 = macrocell_tree{load_tree, columnar_file};
+    REQUIRE(tree == tree3);
+    REQUIRE(tree3.validate());
+
+    //Converting back to a protobuf loads the same tree as well.
+    auto converted_file = boost::filesystem::current_path() / "vessel_tree.converted.pbz";
+    {
+      auto vt = to_vessel_tree(columnar_tree{columnar_file});
+      protobuf_zip_ostream out_stream{converted_file};
+      REQUIRE(vt.SerializeToZeroCopyStream(out_stream.get()));
+    }
+    auto tree4 = macrocell_tree{load_tree, converted_file};
+    REQUIRE(tree == tree4);
+
+    //Vessels stored children-first still stream into the same tree.
+    auto reversed_file = boost::filesystem::current_path() / "vessel_tree.reversed.pbz";
+    {
+      auto vt = load_vessel_tree(saved_file);
+      std::reverse(vt.mutable_vessels()->begin(), vt.mutable_vessels()->end());
+      protobuf_zip_ostream out_stream{reversed_file};
+      REQUIRE(vt.SerializeToZeroCopyStream(out_stream.get()));
+    }
+    auto tree5 = macrocell_tree{load_tree, reversed_file};
+    REQUIRE(tree == tree5);
+
+    //As do trees split over many chunks.
+    auto chunked_file = boost::filesystem::current_path() / "vessel_tree.chunked.pbz";
+    write_chunked_vessel_tree(load_vessel_tree(reversed_file), chunked_file, 100);
+    REQUIRE(chunked_vessel_tree{chunked_file}.num_chunks() > 1);
+    auto tree6 = macrocell_tree{load_tree, chunked_file};
+    REQUIRE(tree == tree6);
+    google::protobuf::ShutdownProtobufLibrary();
+}
+
+TEST_CASE( "Columnar conversion rejects malformed child links", "[columnar_tree]" ) {
+    jhmi_message::VesselTree vt;
+    auto add = [&](int id, int parent, int left, int right) {
+      auto v = vt.add_vessels();
+      v->set_id(id);
+      v->set_parent(parent);
+      v->set_left(left);
+      v->set_right(right);
+    };
+    add(10, -1, 11, 12);
+    add(11, 10, -1, 13);
+    add(12, 10, -1, -1);
+    add(13, 11, -1, -1);
+    auto file = boost::filesystem::current_path() / "malformed.col";
+    write_columnar_tree(vt, file);
+    REQUIRE(columnar_tree{file}.num_vessels() == 4);
+    boost::filesystem::remove(file);
+
+    auto cycle = vt;
+    cycle.mutable_vessels(3)->set_left(11);//13 -> 11 -> 13
+    REQUIRE_THROWS(write_columnar_tree(cycle, file));
+    auto shared = vt;
+    shared.mutable_vessels(2)->set_left(13);//13 listed by 11 and 12
+    REQUIRE_THROWS(write_columnar_tree(shared, file));
+    auto twice = vt;
+    twice.mutable_vessels(1)->set_left(13);//13 as both children of 11
+    REQUIRE_THROWS(write_columnar_tree(twice, file));
+    REQUIRE(!boost::filesystem::exists(file));
+}
+
+TEST_CASE( "Deferred flow updates match eager ones", "[macrocell_tree]" ) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+    std::random_device::result_type seed = 100;
+    auto initial_vessels = "../data/vtree_cycle0.txt";
+    auto liver = voxelized_shape{"../data/liver_extents.datz"};
+    const int cycles = 3;
+    auto final_radius = 7_mm;
+    auto eager = macrocell_tree{build_tree, initial_vessels, liver, seed, cubic_meters_per_second{400. * mL / minutes}, 2.7, 25_mmHg, true, false /*defer_flows*/};
+    auto deferred = macrocell_tree{build_tree, initial_vessels, liver, seed, cubic_meters_per_second{400. * mL / minutes}, 2.7, 25_mmHg, true, true /*defer_flows*/};
+    eager.build(cycles, final_radius);
+    deferred.build(cycles, final_radius);
+    REQUIRE(deferred.validate());
+    REQUIRE(eager == deferred);
+    google::protobuf::ShutdownProtobufLibrary();
+}
+
+TEST_CASE( "Parallel growth is independent of thread count", "[macrocell_tree]" ) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+    std::random_device::result_type seed = 100;
+    auto initial_vessels = "../data/vtree_cycle0.txt";
+    auto liver = voxelized_shape{"../data/liver_extents.datz"};
+    const int cycles = 3;
+    auto final_radius = 7_mm;
+    auto build = [&](std::size_t threads) {
+      tbb::global_control limit{tbb::global_control::max_allowed_parallelism, threads};
+      auto tree = std::make_unique<macrocell_tree>(build_tree, initial_vessels, liver, seed, cubic_meters_per_second{400. * mL / minutes}, 2.7, 25_mmHg);
+      tree->set_parallel_growth(true);
+      tree->build(cycles, final_radius);
+      return tree;
+    };
+    auto serial = build(1);
+    auto parallel = build(4);
+    REQUIRE(parallel->validate());
+    REQUIRE(*serial == *parallel);
+    google::protobuf::ShutdownProtobufLibrary();
+}
+
+TEST_CASE( "Cost-optimal connection builds valid trees", "[macrocell_tree]" ) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+    std::random_device::result_type seed = 100;
+    auto initial_vessels = "../data/vtree_cycle0.txt";
+    auto liver = voxelized_shape{"../data/liver_extents.datz"};
+    const int cycles = 3;
+    auto final_radius = 7_mm;
+    for (auto cost : {connection_cost::volume, connection_cost::power}) {
+      auto tree = std::make_unique<macrocell_tree>(build_tree, initial_vessels, liver, seed, cubic_meters_per_second{400. * mL / minutes}, 2.7, 25_mmHg);
+      tree->set_connection_cost(cost);
+      tree->verify_normalize(true);
+      tree->build(cycles, final_radius);
+      REQUIRE(tree->validate());
+    }
+    google::protobuf::ShutdownProtobufLibrary();
+}
+
+TEST_CASE( "Resuming from a checkpoint matches an uninterrupted build", "[macrocell_tree]" ) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+    std::random_device::result_type seed = 100;
+    auto initial_vessels = "../data/vtree_cycle0.txt";
+    auto liver = voxelized_shape{"../data/liver_extents.datz"};
+    const int cycles = 3;
+    auto final_radius = 7_mm;
+    auto checkpoint = boost::filesystem::current_path() / "build_checkpoint.pbz";
+    //operator== allows for rounding, so the stored trees are compared instead.
+    auto serialized = [](macrocell_tree const& tree) {
+      jhmi_message::VesselTree vt;
+      tree.vessel_tree().store(vt);
+      tree.macrocells().store(vt);
+      return vt.SerializeAsString();
+    };
+    for (bool parallel : {false, true}) {
+      auto tree = std::make_unique<macrocell_tree>(build_tree, initial_vessels, liver, seed, cubic_meters_per_second{400. * mL / minutes}, 2.7, 25_mmHg);
+      tree->set_parallel_growth(parallel);
+      if (parallel)
+        tree->set_connection_cost(connection_cost::volume);
+      tree->set_checkpoint(checkpoint);
+      tree->build(cycles, final_radius);
+
+      //The checkpoint left is from before the last cycle, and carries the
+      // settings the build was started with.
+      auto resumed = std::make_unique<macrocell_tree>(resume_build, checkpoint, liver);
+      REQUIRE(resumed->parallel_growth() == parallel);
+      REQUIRE(resumed->current_connection_cost() == tree->current_connection_cost());
+      resumed->build(cycles, final_radius);
+      REQUIRE(resumed->validate());
+      REQUIRE(serialized(*tree) == serialized(*resumed));
+
+      //The tree is kept beside the checkpoint rather than in it, and only
+      // the one the checkpoint names is left.
+      auto tree_file = checkpoint_tree_file(checkpoint);
+      REQUIRE(!load_protobuf<jhmi_message::BuildCheckpoint>(checkpoint).has_tree());
+      REQUIRE(is_chunked_vessel_tree(tree_file));
+      REQUIRE(!boost::filesystem::exists(checkpoint.string() + fmt::format(".{:02}.tree", cycles - 2)));
+      remove_build_checkpoint(checkpoint);
+      REQUIRE(!boost::filesystem::exists(checkpoint));
+      REQUIRE(!boost::filesystem::exists(tree_file));
+    }
+    google::protobuf::ShutdownProtobufLibrary();
+}
+
+TEST_CASE( "Delta snapshots load as the full snapshots would", "[macrocell_tree]" ) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+    std::random_device::result_type seed = 100;
+    auto initial_vessels = "../data/vtree_cycle0.txt";
+    auto liver = voxelized_shape{"../data/liver_extents.datz"};
+    const int cycles = 4;
+    auto final_radius = 7_mm;
+    auto p = boost::filesystem::current_path();
+    auto full = macrocell_tree{build_tree, initial_vessels, liver, seed, cubic_meters_per_second{400. * mL / minutes}, 2.7, 25_mmHg};
+    full.build(cycles, final_radius, p, "full_tree.{:02}.pbz");
+    auto delta = macrocell_tree{build_tree, initial_vessels, liver, seed, cubic_meters_per_second{400. * mL / minutes}, 2.7, 25_mmHg};
+    delta.set_delta_snapshots(true);
+    delta.build(cycles, final_radius, p, "delta_tree.{:02}.pbz");
+    REQUIRE(!is_delta_snapshot(p / "delta_tree.00.pbz"));
+    //operator== allows for rounding, so the stored trees are compared instead,
+    // in id order as load_snapshot gives a delta's.
+    auto serialized = [](jhmi_message::VesselTree vt) {
+      auto by_id = [](auto const& l, auto const& r) { return l.id() < r.id(); };
+      std::sort(vt.mutable_vessels()->begin(), vt.mutable_vessels()->end(), by_id);
+      std::sort(vt.mutable_macrocells()->begin(), vt.mutable_macrocells()->end(), by_id);
+      return vt.SerializeAsString();
+    };
+    for (int cycle = 1; cycle < cycles - 1; ++cycle) {
+      auto file = delta_snapshot_file(p / fmt::format("delta_tree.{:02}.pbz", cycle));
+      auto full_file = p / fmt::format("full_tree.{:02}.pbz", cycle);
+      REQUIRE(is_delta_snapshot(file));
+      REQUIRE(serialized(load_snapshot(file)) == serialized(load_vessel_tree(full_file)));
+      //Rescaled vessels are stored as their new radii and pressures alone.
+      auto delta = load_protobuf<jhmi_message::VesselTreeDelta>(file, int(sizeof(jhmi_detail::delta_magic)));
+      REQUIRE(delta.rescaled_vessels_size() > 0);
+    }
     google::protobuf::ShutdownProtobufLibrary();
 }
@@ -14,6 +14,22 @@ int main(int argc, char* argv[]) {
   }
   auto tree1 = macrocell_tree{load_tree, argv[1]};
   auto tree2 = macrocell_tree{load_tree, argv[2]};
+  auto const& vessels1 = tree1.vessel_tree();
+  auto const& vessels2 = tree2.vessel_tree();
+  auto const& hashes1 = vessels1.hashes();
+  auto const& hashes2 = vessels2.hashes();
+  //Only subtrees whose hashes differ are searched for changed vessels.
+  auto changed = diff_vessel_trees(vessels1.root(), hashes1, vessels2.root(), hashes2,
+    [](auto lhs, auto rhs) {
+      if (!rhs)
+        fmt::print("Vessel {} (and its subtree) is only in the first tree\n", lhs.value().id());
+      else if (!lhs)
+        fmt::print("Vessel {} (and its subtree) is only in the second tree\n", rhs.value().id());
+      else
+        fmt::print("Vessel {} differs from vessel {}\n", lhs.value().id(), rhs.value().id());
+    });
+  fmt::print("{} vessels differ\n", changed);
+  bool same = changed == 0 && tree1.macrocells() == tree2.macrocells();
   google::protobuf::ShutdownProtobufLibrary();
-  return tree1 == tree2 ? 0 : 1;
+  return same ? 0 : 1;
 }
@@ -3,16 +3,17 @@
 #include "shape/voxelized_shape.hpp"
 #include "utility/load_protobuf.hpp"
 #include "utility/options.hpp"
+#include "utility/philox.hpp"
 
 using namespace jhmi;
 
 struct shape_sampler {
-  std::mt19937& eng_;
+  philox4x32& eng_;
   voxelized_shape const& shape_;
   m3 dims_;
   std::uniform_real_distribution<> d_;
 
-  shape_sampler(std::mt19937& eng, voxelized_shape const& shape)
+  shape_sampler(philox4x32& eng, voxelized_shape const& shape)
     : eng_{eng}, shape_{shape}, dims_{dimensions(extents(shape))} {}
 
   m3 operator()() {
@@ -66,7 +67,7 @@ public:
 
 };
 
-dbl3x3 random_rotation(std::mt19937& eng) {
+dbl3x3 random_rotation(philox4x32& eng) {
   //generate quaternion, then convert it to a rotation matrix m:
   auto dist = std::normal_distribution<>{};
   auto a = dist(eng);
@@ -95,7 +96,7 @@ int main(int argc, char* argv[]) {
   auto spheres = load_protobuf<jhmi_message::SphereLocs>(opts.spherefile());
 
   //Sample a random location and orientation in the shape.
-  std::mt19937 eng{opts.seed()};
+  philox4x32 eng{opts.seed()};
   //Samples a random location within the liver.
   auto center = shape_sampler{eng, liver}();
   auto rot = random_rotation(eng);
@@ -45,7 +45,7 @@ namespace jhmi {
   //static constexpr auto const min_vessel_length = 250_um;
   static constexpr auto const min_vessel_length = 25_um;
 
-  auto concurrent(tract_tree const& ttree, std::mt19937& gen, int num_spheres,
+  auto concurrent(tract_tree const& ttree, philox4x32& gen, int num_spheres,
                   double straight_ratio, m min90, m max90, boost::optional<m> max_diameter,
                   std::atomic<int>& pct_done) {
     auto mv = distribute_tree<volume_vessel>{ttree, straight_ratio};
@@ -54,9 +54,9 @@ namespace jhmi {
 #define ALL
 #ifdef ALL
     auto diameter_sampler = truncated_gaussian{
-      gaussian_90_sampler{gen, min90, max90}, 0_mm, max_diameter};
+      gaussian_90_sampler{min90, max90}, 0_mm, max_diameter};
 #else
-    auto diameter_sampler = [] { return 25_um; };
+    auto diameter_sampler = [](philox4x32&) { return 25_um; };
 #endif
     auto injection_time = 10. * seconds;
     //The time step is related to how quickly blood flows through the arteries.
@@ -94,7 +94,7 @@ namespace jhmi {
       spheres_left -= current_spheres;
 
       vessels[0].current.spheres |= ranges::action::push_back(ranges::view::generate_n([&] {
-        return sphere_info{0., diameter_sampler() / 2., 1.}; }, current_spheres));
+        return sphere_info{0., diameter_sampler(gen) / 2., 1.}; }, current_spheres));
       auto flow_distance = [](volume_vessel const& vv, auto flow, s tdelta) {
         return double(flow * tdelta / vv.cross_section / vv.length);
       };
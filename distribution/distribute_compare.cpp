@@ -2,6 +2,7 @@
 #include "messages/sphere_tracts.pb.h"
 #include "utility/gaussian.hpp"
 #include "utility/options.hpp"
+#include "utility/philox.hpp"
 #include "utility/volume_image.hpp"
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
@@ -14,22 +15,20 @@ namespace po = boost::program_options;
 using namespace jhmi;
 
 auto compare_distributions(tract_tree const& tree, double straight_ratio,
-    std::mt19937& gen, int num_comparisons,
+    philox4x32 const& gen, int num_comparisons,
     m min90_0, m max90_0, m max0, m min90_1, m max90_1, m max1) {
   auto mv = distribute_tree<distribute_vessel>{tree, straight_ratio};
-  auto nd0 = truncated_gaussian{gaussian_90_sampler{gen, min90_0, max90_0}, 0_mm, max0};
-  auto nd1 = truncated_gaussian{gaussian_90_sampler{gen, min90_1, max90_1}, 0_mm, max1};
-
-  auto seeds  = ranges::view::generate_n([&] { return gen(); }, num_comparisons) | ranges::to_vector;
-  auto radii0 = ranges::view::generate_n([&] { return nd0(); }, num_comparisons) | ranges::to_vector;
-  auto radii1 = ranges::view::generate_n([&] { return nd1(); }, num_comparisons) | ranges::to_vector;
+  auto nd0 = truncated_gaussian{gaussian_90_sampler{min90_0, max90_0}, 0_mm, max0};
+  auto nd1 = truncated_gaussian{gaussian_90_sampler{min90_1, max90_1}, 0_mm, max1};
 
+  //Comparison i draws everything from substream i, so nothing is generated up
+  // front and the result doesn't depend on how the range is partitioned.
   std::atomic<int> idx{0};
-  return tbb::parallel_reduce(tbb::blocked_range<size_t>(0, num_comparisons), m3{},
+  return tbb::parallel_deterministic_reduce(tbb::blocked_range<size_t>(0, num_comparisons, 1024), m3{},
     [&](tbb::blocked_range<size_t> const& prange, m3 diffs) {
       for(auto i = prange.begin(); i != prange.end(); ++i) {
-        std::mt19937 tgen{seeds[i]};
-        auto r0 = radii0[i], r1 = radii1[i];
+        auto tgen = gen.substream(i);
+        auto r0 = nd0(tgen), r1 = nd1(tgen);
 
         auto urd = std::uniform_real_distribution<>{};
         auto branch_rand = std::bind(urd, std::ref(tgen));
@@ -93,7 +92,7 @@ int main(int argc, char* argv[]) {
       return 1;
 
     auto tree = tract_tree{opts.treefile().string()};
-    auto gen = std::mt19937{opts.seed()};
+    auto gen = philox4x32{opts.seed()};
     fmt::print("Beginning distribution\n");
     auto start = std::chrono::high_resolution_clock::now();
     auto means = compare_distributions(tree, straight_ratio, gen, comparisons,
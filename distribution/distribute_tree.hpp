@@ -3,6 +3,9 @@
 
 #include "liver/tract_tree.hpp"
 #include "utility/maybe.hpp"
+#include "utility/philox.hpp"
+#include <cstdint>
+#include <vector>
 
 namespace jhmi {
   struct vessel_spheres {
@@ -11,22 +14,18 @@ namespace jhmi {
     m3 end;
     int count = 0;
   };
+  //The state of each vessel of a tract_tree as particles are distributed
+  // through it.  VesselTypes are held in the tree's preorder and reached
+  // through its index arrays, so walking the tree needs no lookups by id.
   template <typename VesselType>
   class distribute_tree {
     tract_tree const& tree_;
-    std::unordered_map<vessel_id, VesselType> v_;
+    std::vector<VesselType> v_;
     double straight_ratio_;
 
-    auto& at(binary_const_node_t<flow_vessel> n) {
-      return v_.at(n.value().id);
-    }
-    auto const& at(binary_const_node_t<flow_vessel> n) const {
-      return v_.at(n.value().id);
-    }
-
-    void update_flow(binary_const_node_t<flow_vessel> n) {
-      auto& lmv = at(n.left_child());
-      auto& rmv = at(n.right_child());
+    void update_flow(std::int32_t i) {
+      auto& lmv = v_[tree_.left(i)];
+      auto& rmv = v_[tree_.right(i)];
       auto lf = lmv.flow;
       auto rf = rmv.flow;
       auto D_l = lf / (lf+rf);
@@ -34,13 +33,20 @@ namespace jhmi {
 
       lmv.p = D_l * straight_ratio_ / (D_l * straight_ratio_ + D_r * (1 - straight_ratio_));
       rmv.p = 1 - lmv.p;
-      at(n).flow = lf + rf;
+      v_[i].flow = lf + rf;
+    }
+    //Recomputes i's flow from its children's.
+    void update_from_children(std::int32_t i) {
+      if (tree_.left(i) >= 0 && tree_.right(i) >= 0)
+        update_flow(i);
+      else if (tree_.left(i) >= 0)
+        v_[i].flow = v_[tree_.left(i)].flow;
     }
-    auto* from_node(binary_const_node_t<flow_vessel> n) {
-      return n ? &v_.at(n.value().id) : nullptr;
+    auto* from_index(std::int32_t i) {
+      return i >= 0 ? &v_[i] : nullptr;
     }
-    auto const* from_node(binary_const_node_t<flow_vessel> n) const {
-      return n ? &v_.at(n.value().id) : nullptr;
+    auto const* from_index(std::int32_t i) const {
+      return i >= 0 ? &v_[i] : nullptr;
     }
   public:
     enum class traversal { left, right, stop, abort };
@@ -48,70 +54,63 @@ namespace jhmi {
     distribute_tree(tract_tree const& tree, double straight_ratio)
      : tree_{tree}, v_{}, straight_ratio_{straight_ratio} {
       m min_rad = 100_mm;
-      for (auto n : tree_.vessel_nodes_postorder()) {
-        auto& v = n.value();
-        min_rad = std::min(min_rad, v.radius);
+      v_.reserve(tree_.size());
+      for (std::int32_t i = 0; i < std::int32_t(tree_.size()); ++i) {
+        min_rad = std::min(min_rad, tree_.vessel(i).radius);
         //auto volume = v.radius * v.radius * pi * distance(v.start - v.end);
-        v_.insert(std::make_pair(v.id, VesselType{v}));
-        if (n.left_child() && n.right_child())
-          update_flow(n);
+        v_.emplace_back(tree_.vessel(i));
+      }
+      for (auto i : tree_.post_order()) {
+        if (tree_.left(i) >= 0 && tree_.right(i) >= 0)
+          update_flow(i);
       }//for
       fmt::print("Min radius in distribute_tree: {:1.10f}\n", min_rad.value());
     }
     void update_flows() {
-      for (auto n : tree_.vessel_nodes_postorder()) {
-        if (n.left_child() && n.right_child())
-          update_flow(n);
-        else if (n.left_child())
-          at(n).flow = at(n.left_child()).flow;
-      }
+      for (auto i : tree_.post_order())
+        update_from_children(i);
     }
     template <typename F>
     void traverse_individual(F f) {
-      auto call_f = [=](binary_const_node_t<flow_vessel> n) {
-        return f(at(n), n.value(), from_node(n.left_child()), from_node(n.right_child()));
+      auto call_f = [&](std::int32_t i) {
+        return f(v_[i], tree_.vessel(i), from_index(tree_.left(i)), from_index(tree_.right(i)));
       };
-      auto node = tree_.root_node();
-      auto result = call_f(node);
+      std::int32_t i = 0;
+      auto result = call_f(i);
       while (result != traversal::stop && result != traversal::abort) {
         if (result == traversal::left)
-          node = node.left_child();
+          i = tree_.left(i);
         else
-          node = node.right_child();
-        result = call_f(node);
+          i = tree_.right(i);
+        result = call_f(i);
       }
       //User has not modified flow.
       if (result == traversal::abort)
         return;
-      while (node.parent()) {
-        node = node.parent();
-        if (node.left_child() && node.right_child())
-          update_flow(node);
-        else if (node.left_child())
-          at(node).flow = at(node.left_child()).flow;
-      }
+      for (i = tree_.parent(i); i >= 0; i = tree_.parent(i))
+        update_from_children(i);
     }
     struct vessel_cluster { VesselType& current, * left, * right, * parent; flow_vessel const& fixed; };
     auto vessel_clusters_preorder() {
-      return tree_.vessel_nodes_preorder() | ranges::view::transform(
-        [this](binary_const_node_t<flow_vessel> n) {
-          return vessel_cluster{at(n), from_node(n.left_child()),
-            from_node(n.right_child()), from_node(n.parent()), n.value()};
+      return ranges::view::ints(std::int32_t(0), std::int32_t(tree_.size())) | ranges::view::transform(
+        [this](std::int32_t i) {
+          return vessel_cluster{v_[i], from_index(tree_.left(i)),
+            from_index(tree_.right(i)), from_index(tree_.parent(i)), tree_.vessel(i)};
         });
     }
     struct const_vessel_cluster { VesselType const& current, * left, * right, * parent; flow_vessel const& fixed; };
     auto vessel_clusters_preorder() const {
-      return tree_.vessel_nodes_preorder() | ranges::view::transform(
-        [this](binary_const_node_t<flow_vessel> n) {
-          return const_vessel_cluster{at(n), from_node(n.left_child()),
-            from_node(n.right_child()), from_node(n.parent()), n.value()};
+      return ranges::view::ints(std::int32_t(0), std::int32_t(tree_.size())) | ranges::view::transform(
+        [this](std::int32_t i) {
+          return const_vessel_cluster{v_[i], from_index(tree_.left(i)),
+            from_index(tree_.right(i)), from_index(tree_.parent(i)), tree_.vessel(i)};
         });
     }
     auto vessel_clusters_postorder() const {
-      return tree_.vessel_nodes_postorder() | ranges::view::transform(
-        [this](binary_const_node_t<flow_vessel> n) {
-          return const_vessel_cluster{at(n), from_node(n.left_child()),
-            from_node(n.right_child()), from_node(n.parent()), n.value()};
+      return tree_.post_order() | ranges::view::transform(
+        [this](std::int32_t i) {
+          return const_vessel_cluster{v_[i], from_index(tree_.left(i)),
+            from_index(tree_.right(i)), from_index(tree_.parent(i)), tree_.vessel(i)};
         });
     }
   };
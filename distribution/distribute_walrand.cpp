@@ -23,7 +23,7 @@ namespace po = boost::program_options;
 using namespace jhmi;
 
 namespace {
-  using distributor = std::function<std::pair<std::vector<std::pair<m3,vessel_id>>,std::vector<int>>(std::mt19937&&, std::atomic<int>&)>;
+  using distributor = std::function<std::pair<std::vector<std::pair<m3,vessel_id>>,std::vector<int>>(philox4x32&&, std::atomic<int>&)>;
 
   auto write_sphere_clusters_bin(std::vector<int> const& clusters,
                                  boost::filesystem::path const& p) {
@@ -122,30 +122,30 @@ int main(int argc, char* argv[]) {
     auto dist = distributor{};
 
     if (method == "unembolized") {
-      dist = [=,&tree](std::mt19937&& rng, std::atomic<int>& pct_done) {
+      dist = [=,&tree](philox4x32&& rng, std::atomic<int>& pct_done) {
         return unembolized(tree, rng, usphere_count, straight_ratio, pct_done);
       };
     }
     else if (method == "embolized") {
-      dist = [=,&tree](std::mt19937&& rng, std::atomic<int>& pct_done) {
+      dist = [=,&tree](philox4x32&& rng, std::atomic<int>& pct_done) {
         return embolized(tree, rng, usphere_count, spheres_per_tract, straight_ratio, pct_done);
       };
     }
     else if (method == "radiized") {
-      dist = [=,&tree](std::mt19937&& rng, std::atomic<int>& pct_done) {
+      dist = [=,&tree](philox4x32&& rng, std::atomic<int>& pct_done) {
         return radiized(tree, rng, usphere_count, spheres_per_tract, straight_ratio,
                         min90, max90, max_diameter, pct_done);
       };
     }
     else if (method == "unradiized") {
-      dist = [=,&tree](std::mt19937&& rng, std::atomic<int>& pct_done) {
+      dist = [=,&tree](philox4x32&& rng, std::atomic<int>& pct_done) {
         return radiized(tree, rng, usphere_count,
                         std::numeric_limits<double>::infinity(), straight_ratio,
                         min90, max90, max_diameter, pct_done);
       };
     }
     else if (method == "concurrent") {
-      dist = [=,&tree](std::mt19937&& rng, std::atomic<int>& pct_done) {
+      dist = [=,&tree](philox4x32&& rng, std::atomic<int>& pct_done) {
         return concurrent(tree, rng, usphere_count, straight_ratio,
                           min90, max90, max_diameter, pct_done);
       };
@@ -169,7 +169,7 @@ int main(int argc, char* argv[]) {
       out << fmt::format("Random seed: {}\n", seed);
       auto& pct_done = task_pcts[i];
       tasks.push_back(std::async(std::launch::async, [=, &pct_done] {
-        auto [sphere_locs,clusters] = dist(std::mt19937{seed}, pct_done);
+        auto [sphere_locs,clusters] = dist(philox4x32{seed}, pct_done);
         write_sphere_locs_bin(sphere_locs, output_directory);
         write_sphere_clusters_bin(clusters, output_directory);
         //write_sphere_locs_protobuf(sphere_locs, output_directory);
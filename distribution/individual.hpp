@@ -6,7 +6,7 @@
 namespace jhmi {
   std::vector<int> determine_clusters(distribute_tree<distribute_vessel> const& tree,
                                       m avg_sphere_diameter) {
-    auto vessels = std::unordered_map<vessel_id, std::pair<m, int>>{};
+    auto vessels = vidx_to<std::pair<m, int>>{};
 
     auto clusters = std::vector<int>{};
     for (auto v : tree.vessel_clusters_postorder()) {
@@ -37,14 +37,17 @@ namespace jhmi {
     return clusters;
   }
   template <typename SphereSampler>
-  auto distribute_individual(tract_tree const& tree, std::mt19937& gen,
+  auto distribute_individual(tract_tree const& tree, philox4x32& gen,
       int num_spheres, double spheres_per_tract, double straight_ratio,
       std::atomic<int>& pct_done, SphereSampler sample_sphere) {
     auto mv = distribute_tree<distribute_vessel>{tree, straight_ratio};
     auto urd = std::uniform_real_distribution<>{};
-    auto branch_rand = std::bind(urd, std::ref(gen));
+    //Each sphere draws from its own substream, so its path doesn't depend on
+    // how many draws the spheres before it took.
     RANGES_FOR(auto i, ranges::view::ints(0, num_spheres)) {
-      auto sphere_radius = sample_sphere();
+      auto sphere_gen = gen.substream(i);
+      auto branch_rand = std::bind(urd, std::ref(sphere_gen));
+      auto sphere_radius = sample_sphere(sphere_gen);
       mv.traverse_individual([&](distribute_vessel& dv, flow_vessel const& fv,
          distribute_vessel const* left, distribute_vessel const* right) {
         //Next, determine if this is the last sphere location
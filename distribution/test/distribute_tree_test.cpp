@@ -1,4 +1,5 @@
 #include "distribution/concurrent.hpp"
+#include <boost/filesystem.hpp>
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
@@ -19,13 +20,86 @@ TEST_CASE( "Testing simple tree", "[distribute]" ) {
       flow_vessel(vessel_id{8}, dbl3{3,1,0}*mm, dbl3{4,2,0}*mm, 5_um, .22*flow),
       flow_vessel(vessel_id{9}, dbl3{3,1,0}*mm, dbl3{4,3,0}*mm, 10_um, .33*flow)}
     }};
-  std::mt19937 eng;
+  philox4x32 eng;
   std::atomic<int> pct_done;
   auto [spheres,clusters] = concurrent(tt, eng, 2, .6, 15_um, 35_um, boost::none, pct_done);
   for (auto&& s : spheres) {
     fmt::print("Sphere at {} in vessel {}\n", dbl3{1000.*s.first/meters}, s.second);
   }
 }
+TEST_CASE( "Stopping a sphere updates flows back to the root", "[distribute]" ) {
+  auto flow = 1. * meters * meters * meters / seconds;
+  auto tt = tract_tree{binary_tree<flow_vessel>{
+    {flow_vessel(vessel_id{1}, m3{}, dbl3{1,0,0}*mm, 1.5_mm, 1.*flow)},
+    {flow_vessel(vessel_id{2}, dbl3{1,0,0}*mm, dbl3{2,0,0}*mm, 1_mm, .5*flow),
+      flow_vessel(vessel_id{3}, dbl3{1,0,0}*mm, dbl3{2,1,0}*mm, 1_mm, .5*flow)}
+    }};
+  auto mv = distribute_tree<distribute_vessel>{tt, .6};
+  using traversal = distribute_tree<distribute_vessel>::traversal;
+  std::vector<vessel_id> path;
+  mv.traverse_individual([&](distribute_vessel& dv, flow_vessel const& fv,
+      distribute_vessel const* left, distribute_vessel const*) {
+    path.push_back(fv.id);
+    if (!left) {
+      dv.flow = .25 * flow;
+      return traversal::stop;
+    }
+    return traversal::left;
+  });
+  REQUIRE(path == std::vector<vessel_id>{vessel_id{1}, vessel_id{2}});
+  auto vessels = mv.vessel_clusters_preorder() | ranges::to_vector;
+  REQUIRE(vessels[0].current.flow == .75 * flow);
+  //With a third of the flow, the left vessel takes .6 / (.6 + 2 * .4) of the spheres.
+  REQUIRE(vessels[1].current.p == Approx(.6 / 1.4));
+  REQUIRE(vessels[2].current.p == Approx(1 - .6 / 1.4));
+}
+
+TEST_CASE( "Tract trees are cached next to their tree files", "[distribute]" ) {
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+  //A root with two children, each of which should get a tract.
+  jhmi_message::VesselTree vt;
+  auto add_vessel = [&](int id, int parent, int left, int right, dbl3 start, dbl3 end) {
+    auto v = vt.add_vessels();
+    v->set_id(id);
+    v->set_parent(parent);
+    v->set_left(left);
+    v->set_right(right);
+    v->set_radius(1e-4);
+    v->set_flow(1e-8);
+    v->set_sx(start.x); v->set_sy(start.y); v->set_sz(start.z);
+    v->set_ex(end.x); v->set_ey(end.y); v->set_ez(end.z);
+  };
+  auto none = vessel_id::invalid().value();
+  add_vessel(1, none, 2, 3, dbl3{0,0,0}, dbl3{1e-3,0,0});
+  add_vessel(2, 1, none, none, dbl3{1e-3,0,0}, dbl3{1e-3,1e-3,0});
+  add_vessel(3, 1, none, none, dbl3{1e-3,0,0}, dbl3{2e-3,0,0});
+  auto file = boost::filesystem::current_path() / "tract_test_tree.pbz";
+  write_chunked_vessel_tree(vt, file);
+  auto cache = tract_tree::cache_path(file, tract_tree::tree_hash(file));
+  boost::filesystem::remove(cache);
+
+  auto built = tract_tree{file};
+  REQUIRE(boost::filesystem::exists(cache));
+  auto cached = tract_tree{file};
+  REQUIRE(built.size() == 5);
+  REQUIRE(cached.size() == built.size());
+  auto root = cached.root_node();
+  REQUIRE(root.value().id == vessel_id{1});
+  for (auto n : cached.vessel_nodes_preorder()) {
+    auto b = built.node(n.index());
+    REQUIRE(n.value().id == b.value().id);
+    REQUIRE(n.value().end == b.value().end);
+    REQUIRE(n.left_child().index() == b.left_child().index());
+    REQUIRE(n.right_child().index() == b.right_child().index());
+    REQUIRE(n.parent().index() == b.parent().index());
+    //Every vessel but a tract has one.
+    REQUIRE((n.value().id.value() > 3) == !n.left_child());
+  }
+  auto post = cached.vessel_nodes_postorder() | ranges::to_vector;
+  REQUIRE(post.back().index() == root.index());
+  google::protobuf::ShutdownProtobufLibrary();
+}
+
 /*
   Sphere at [0.003 m,0 m,0 m] in vessel 7
   Sphere at [0.003 m,0 m,0 m] in vessel 7
@@ -4,7 +4,7 @@
 #include "distribution/distribute_tree.hpp"
 
 namespace jhmi {
-  auto unembolized(tract_tree const& ttree, std::mt19937& gen,
+  auto unembolized(tract_tree const& ttree, philox4x32& gen,
                    int num_spheres, double straight_ratio, std::atomic<int>& pct) {
     auto mv = distribute_tree<distribute_vessel>{ttree, straight_ratio};
     auto vessels = mv.vessel_clusters_preorder() | ranges::to_vector;
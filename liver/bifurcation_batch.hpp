@@ -0,0 +1,135 @@
+#ifndef JHMI_LIVER_BIFURCATION_BATCH_HPP_NRC_20261019
+#define JHMI_LIVER_BIFURCATION_BATCH_HPP_NRC_20261019
+
+#include "liver/constants.hpp"
+#include "utility/units.hpp"
+#include <boost/optional.hpp>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace jhmi {
+
+  //Solves find_bifurcation_point for many problems at once, in double
+  // precision.  Rather than rotating each triangle into the xy plane with
+  // glm, a problem is solved in an orthonormal frame of its own plane, and
+  // the branch angles are carried as cosines and sines; the only
+  // transcendental calls left are the powers of the flow ratio and the final
+  // angle check.  The construction is otherwise the same, so results match
+  // find_bifurcation_point up to its single-precision rounding, including
+  // the fallback to the triangle's centroid.
+  class bifurcation_batch {
+    struct vec2 { double x, y; };
+    using circle = std::pair<vec2,double>;
+
+    std::vector<dbl3> p0_, p1_, p2_;//In meters; p1 is the branch with more flow.
+    std::vector<double> ratio_;//p1's share of the flow.
+    std::vector<dbl3> pb_;
+
+    static double length(vec2 const& v) { return std::sqrt(v.x*v.x + v.y*v.y); }
+    static vec2 minus(vec2 const& a, vec2 const& b) { return {a.x - b.x, a.y - b.y}; }
+    static std::pair<vec2,vec2> intersect(circle const& c1, circle const& c2) {
+      auto d = length(minus(c1.first, c2.first));
+      auto x1 = c1.first.x; auto y1 = c1.first.y;
+      auto x2 = c2.first.x; auto y2 = c2.first.y;
+      auto r1 = c1.second;  auto r2 = c2.second;
+      auto dd = 2*d*d;
+      auto scalar = std::sqrt(((r1+r2)*(r1+r2)-d*d)*(d*d-(r1-r2)*(r1-r2)));
+      auto mx = (x2+x1)/2 + (x2-x1)*(r1*r1-r2*r2)/dd;
+      auto my = (y2+y1)/2 + (y2-y1)*(r1*r1-r2*r2)/dd;
+      return {vec2{mx + (y2-y1)/dd*scalar, my - (x2-x1)/dd*scalar},
+              vec2{mx - (y2-y1)/dd*scalar, my + (x2-x1)/dd*scalar}};
+    }
+    static bool inside_triangle(vec2 const& pt, vec2 const& t0, vec2 const& t1, vec2 const& t2) {
+      auto a = 1/(-t1.y*t2.x+t0.y*(-t1.x+t2.x)+ t0.x*(t1.y-t2.y)+t1.x*t2.y);
+      auto s = a*(t2.x*t0.y-t0.x*t2.y+(t2.y-t0.y)*pt.x + (t0.x-t2.x)*pt.y);
+      if (s<0)
+        return false;
+      auto t = a*(t0.x*t1.y-t1.x*t0.y+(t0.y-t1.y)*pt.x + (t1.x-t0.x)*pt.y);
+      return t >= 0 && 1 - s - t >= 0;
+    }
+    //The circle through p1 and p2 on which p1 and p2 subtend the angle theta,
+    // given by its cosine and sine.
+    static boost::optional<circle> get_circle(double cos_theta, double sin_theta,
+        vec2 const& p1, vec2 const& p2, vec2 const& p0) {
+      auto r12 = length(minus(p1, p2)) / (2 * sin_theta);
+      auto pts = intersect(circle{p1,r12}, circle{p2,r12});
+      bool obtuse = cos_theta < 0;
+      if (inside_triangle(pts.first, p0, p1, p2) != obtuse)
+        return circle{pts.first, r12};
+      if (inside_triangle(pts.second, p0, p1, p2) != obtuse)
+        return circle{pts.second, r12};
+      return boost::none;
+    }
+    static double angle_between(dbl3 const& v1, dbl3 const& v2) {
+      return std::acos(dot(v1,v2) / (distance(v1)*distance(v2)));
+    }
+
+    dbl3 solve_one(std::size_t i, double togmo) const {
+      auto const& p0 = p0_[i]; auto const& p1 = p1_[i]; auto const& p2 = p2_[i];
+      auto centroid = (p0+p1+p2) / 3.;
+      auto omtog = -togmo;
+      auto tmfog = 2. * omtog;
+      auto r = ratio_[i];
+      auto a = std::pow(r, togmo), b = std::pow(r, omtog), c = a * std::pow(1-r, tmfog);
+      auto cos1 = .5*(a+b-c), cos2 = .5*(a-b+c);
+      if (!(std::abs(cos1) <= 1) || !(std::abs(cos2) <= 1))
+        return centroid;
+      auto sin1 = std::sqrt(1 - cos1*cos1), sin2 = std::sqrt(1 - cos2*cos2);
+
+      auto d1 = p1 - p0, d2 = p2 - p0;
+      auto l1 = distance(d1);
+      auto u = d1 / l1;
+      auto x2 = dot(d2, u);
+      auto w = d2 - x2 * u;
+      auto lw = distance(w);
+      if (!(l1 > 0) || !(lw > 0))
+        return centroid;
+      auto v = w / lw;
+      auto q0 = vec2{0, 0}, q1 = vec2{l1, 0}, q2 = vec2{x2, lw};
+
+      auto c12 = get_circle(cos1*cos2 - sin1*sin2, sin1*cos2 + cos1*sin2, q1, q2, q0);
+      auto c01 = get_circle(-cos1, sin1, q0, q1, q2);
+      if (!c12 || !c01)
+        return centroid;
+      auto bs = intersect(*c12, *c01);
+      auto xy = length(minus(bs.first, q1)) > length(minus(bs.second, q1)) ? bs.first : bs.second;
+      auto pb = p0 + xy.x * u + xy.y * v;
+
+      auto ath1 = angle_between(p1-pb, pb-p0);
+      auto ath2 = angle_between(p2-pb, pb-p0);
+      if (std::isnan(ath1) || std::isnan(ath2)
+          || std::abs(ath1 - std::acos(cos1)) > 1e-2 || std::abs(ath2 - std::acos(cos2)) > 1e-2)
+        return centroid;
+      return pb;
+    }
+
+  public:
+    void clear() {
+      p0_.clear(); p1_.clear(); p2_.clear();
+      ratio_.clear();
+      pb_.clear();
+    }
+    std::size_t size() const { return p0_.size(); }
+
+    //Adds the problem find_bifurcation_point(p0, p1, p2, q1, q2, gamma) solves.
+    void add(m3 const& p0, m3 const& p1, m3 const& p2,
+             cubic_meters_per_second q1, cubic_meters_per_second q2) {
+      auto value = [](m3 const& p) { return dbl3{p.x.value(), p.y.value(), p.z.value()}; };
+      bool swap = !(q1 > q2);
+      p0_.push_back(value(p0));
+      p1_.push_back(value(swap ? p2 : p1));
+      p2_.push_back(value(swap ? p1 : p2));
+      ratio_.push_back(swap ? q2 / (q1+q2) : q1 / (q1+q2));
+    }
+    void solve(double gamma) {
+      auto togmo = 2. / gamma - 1.;
+      pb_.resize(size());
+      for (std::size_t i = 0; i < size(); ++i)
+        pb_[i] = solve_one(i, togmo);
+    }
+    m3 point(std::size_t i) const { return pb_[i] * meters; }
+  };
+}
+
+#endif
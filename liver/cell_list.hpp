@@ -1,21 +1,27 @@
 #ifndef JHMI_LIVER_CELL_LIST_HPP_NRC_20150829
 #define JHMI_LIVER_CELL_LIST_HPP_NRC_20150829
 
+#include "liver/columnar_tree.hpp"
 #include "liver/constants.hpp"
 #include "liver/macrocell.hpp"
 #include "liver/locations/grid_locations.hpp"
 #include "liver/locations/lattice_locations.hpp"
+#include "liver/stream_vessel_tree.hpp"
 #include "messages/vessel_tree.pb.h"
 #include "utility/load_protobuf.hpp"
 #include <range/v3/algorithm.hpp>
 #include <fmt/ostream.h>
 #include <cstdio>
 #include <random>
+#include <vector>
 namespace jhmi {
+  //Cells are kept contiguous, in no particular order: erase moves the last
+  // cell into the gap.  positions_ maps each cell's id to where it is now.
   class cell_list {
-    cidx_to<macrocell> cells_;
+    std::vector<macrocell> cells_;
+    cidx_to<std::size_t> positions_;
     id_generator<cell_tag> get_cell_id_;
-    std::mt19937& gen_;
+    philox4x32& gen_;
     m cell_radius_;
     std::unique_ptr<cell_locations> loc_;
     cube<m3> ext_;
@@ -29,46 +35,88 @@ namespace jhmi {
             voxelized_shape const& liver, m cell_radius, cubic_meters_per_second proper_ha_flow) {
       return std::make_unique<lattice_locations>(liver, cell_radius, proper_ha_flow);
     }
+    macrocell& insert(macrocell const& c) {
+      if (!positions_.insert(std::make_pair(c.id, cells_.size())).second)
+        throw std::runtime_error(fmt::format("Duplicate macrocell id {}", c.id));
+      cells_.push_back(c);
+      return cells_.back();
+    }
+    void set_flow_and_pressure(double tree_flow, double cell_pressure) {
+      cell_pressure_ = cell_pressure * pascals;
+      if (std::abs(cell_pressure) < 1e-5)
+        cell_pressure_ = 25_mmHg;
+      if (std::abs(tree_flow) < 1e-5)
+        proper_ha_flow_ = cubic_meters_per_second{400. * mL / minutes};
+      else
+        proper_ha_flow_ = cubic_meters_per_second{tree_flow * meters * meters * meters / seconds};
+    }
+    //Reads the cells, in their stored order, and the flow and pressure.
+    void load_cells(columnar_tree const& ct) {
+      set_flow_and_pressure(ct.tree_flow(), ct.cell_pressure());
+      cells_.reserve(ct.num_cells());
+      for (std::size_t i = 0; i < ct.num_cells(); ++i)
+        insert(ct.cell(i));
+    }
+    static macrocell to_macrocell(jhmi_message::Macrocell const& vtc) {
+      return macrocell{dbl3{vtc.x(), vtc.y(), vtc.z()}*meters,
+                       vessel_id{vtc.parent_vessel()},
+                       cell_type::normal,
+                       vtc.radius()*meters,
+                       cell_id{vtc.id()},
+                       vtc.flow()*boost::units::pow<3>(meters) / seconds,
+                       vtc.pressure() * pascals,
+                       int3{vtc.idx_x(), vtc.idx_y(), vtc.idx_z()}};
+    }
+    void load_cells(jhmi_message::VesselTree const& vt) {
+      set_flow_and_pressure(vt.tree_flow(), vt.cell_pressure());
+      RANGES_FOR(auto& vtc, vt.macrocells()) {
+        insert(to_macrocell(vtc));
+      }
+    }
+    //As above, but reading the file's cells one at a time.
+    void load_cells(boost::filesystem::path const& filename) {
+      auto values = read_vessel_tree(filename, nullptr, [&](jhmi_message::Macrocell const& vtc) {
+        insert(to_macrocell(vtc));
+      });
+      set_flow_and_pressure(values.tree_flow, values.cell_pressure);
+    }
   public:
-    cell_list(build_tree_tag, std::mt19937& gen, voxelized_shape const& liver, m cell_radius, cubic_meters_per_second proper_ha_flow, Pa cell_pressure)
-      : cells_{}, get_cell_id_{}, gen_(gen),
+    cell_list(build_tree_tag, philox4x32& gen, voxelized_shape const& liver, m cell_radius, cubic_meters_per_second proper_ha_flow, Pa cell_pressure)
+      : cells_{}, positions_{}, get_cell_id_{}, gen_(gen),
         cell_radius_{cell_radius},
         loc_{choose_locations(liver, cell_radius, proper_ha_flow)},
         ext_{extents(liver)}, proper_ha_flow_{proper_ha_flow}, cell_pressure_{cell_pressure} {
     }
     cell_list(load_tree_tag, boost::filesystem::path const& filename,
-              voxelized_shape const& liver, std::mt19937& gen)
-      : cells_{}, get_cell_id_{}, gen_{gen}, ext_{} {
-      auto vt = load_protobuf<jhmi_message::VesselTree>(filename);
-      cell_pressure_ = vt.cell_pressure() * pascals;
-      if (std::abs(vt.cell_pressure()) < 1e-5)
-        cell_pressure_ = 25_mmHg;
-      if (std::abs(vt.tree_flow()) < 1e-5)
-        proper_ha_flow_ = cubic_meters_per_second{400. * mL / minutes};
+              voxelized_shape const& liver, philox4x32& gen)
+      : cells_{}, positions_{}, get_cell_id_{}, gen_{gen}, ext_{} {
+      if (is_columnar_tree(filename))
+        load_cells(columnar_tree{filename});
       else
-        proper_ha_flow_ = cubic_meters_per_second{vt.tree_flow() * meters * meters * meters / seconds};
-
-      int max_id = 0;
+        load_cells(filename);
       boost::optional<cube<m3>> ext;
-      RANGES_FOR(auto& vtc, vt.macrocells()) {
-        macrocell c{dbl3{vtc.x(), vtc.y(), vtc.z()}*meters,
-                    vessel_id{vtc.parent_vessel()},
-                    cell_type::normal,
-                    vtc.radius()*meters,
-                    cell_id{vtc.id()},
-                    vtc.flow()*boost::units::pow<3>(meters) / seconds,
-                    vtc.pressure() * pascals,
-                    int3{vtc.idx_x(), vtc.idx_y(), vtc.idx_z()}};
-        cells_.insert(std::make_pair(c.id, c));
-        max_id = std::max(max_id, vtc.id());
+      for (auto const& c : cells_)
         ext = ext ? unite(*ext, extents(c)) : extents(c);
-      }
       ext_ = *ext;
       if (!cells_.empty()) {
-        cell_radius_ = cells_.begin()->second.radius;
+        cell_radius_ = cells_.front().radius;
         loc_ = choose_locations(liver, cell_radius_, proper_ha_flow_); 
       }
     }
+    //As the build left them, including which cell ids have been used and
+    // which locations are occupied.
+    cell_list(resume_build_tag, jhmi_message::BuildCheckpoint const& cp,
+              voxelized_shape const& liver, philox4x32& gen)
+      : cells_{}, positions_{}, get_cell_id_{cp.last_cell_id()}, gen_{gen},
+        cell_radius_{cp.cell_radius() * meters}, ext_{extents(liver)} {
+      load_cells(cp.tree());
+      loc_ = choose_locations(liver, cell_radius_, proper_ha_flow_);
+      for (auto const& c : cells_)
+        loc_->add_item(c);
+    }
+
+    m cell_radius() const { return cell_radius_; }
+    cell_id last_cell_id() const { return get_cell_id_.last(); }
 
     auto get_cell_flow() const { return loc_->get_flow(nullptr); }
     cell_id add_cell_near(m3 const& loc, boost::optional<m3> end_loc = boost::none) {
@@ -76,33 +124,52 @@ namespace jhmi {
       if (!near_loc) {
         return cell_id::invalid();
       }
+      return add_cell_at(*near_loc, loc_->get_flow(&gen_));
+    }
+    //What add_cell_near would choose, drawing from gen instead, without
+    // changing the list.  Safe to call concurrently.
+    boost::optional<std::pair<m3,int3>> propose_location(m3 const& loc, philox4x32& gen) const {
+      return loc_->find_location(loc, boost::none, gen);
+    }
+    cubic_meters_per_second propose_flow(philox4x32& gen) const {
+      return loc_->get_flow(&gen);
+    }
+    bool is_free(std::pair<m3,int3> const& loc) const { return loc_->is_free(loc); }
+    cell_id add_cell_at(std::pair<m3,int3> const& loc, cubic_meters_per_second flow) {
       auto cell_id = get_cell_id_();
-      auto new_cell = cells_.insert(std::make_pair(cell_id,
-           macrocell{near_loc->first, vessel_id::invalid(), cell_type::normal,
-                     cell_radius_, cell_id, loc_->get_flow(&gen_), cell_pressure_, near_loc->second}));
-      loc_->add_item(new_cell.first->second);
+      loc_->add_item(insert(macrocell{loc.first, vessel_id::invalid(), cell_type::normal,
+                                      cell_radius_, cell_id, flow, cell_pressure_, loc.second}));
       return cell_id;
     }
     void reduce_cell_size(double scale, bool fit_to_lobules) {
       cell_radius_ *= scale;
-      RANGES_FOR(auto& cell, cells_)
-        cell.second.radius *= scale;
+      for (auto& cell : cells_)
+        cell.radius *= scale;
       loc_->reset(cell_radius_, cells_, fit_to_lobules);
       fmt::print("# of potential cell sites: {}\n", loc_->number_of_cells());
     }
     void erase(cell_id id) {
-      loc_->remove_item(at(id));
-      cells_.erase(id);
+      auto pos = positions_.at(id);
+      loc_->remove_item(cells_[pos]);
+      if (pos + 1 != cells_.size()) {
+        cells_[pos] = cells_.back();
+        positions_.at(cells_[pos].id) = pos;
+      }
+      cells_.pop_back();
+      positions_.erase(id);
     }
-    macrocell& at(cell_id id) { return cells_.at(id); }
-    macrocell const& at(cell_id id) const { return cells_.at(id); }
+    //References are invalidated by adding or erasing cells.
+    macrocell& at(cell_id id) { return cells_[positions_.at(id)]; }
+    macrocell const& at(cell_id id) const { return cells_[positions_.at(id)]; }
 
-    auto list() const { return cells_ | ranges::view::values; }
+    auto list() const { return ranges::view::all(cells_); }
 
-    void store(jhmi_message::VesselTree& vt) const {
+    //vt is a jhmi_message::VesselTree or a chunked_tree_writer.
+    template <typename VesselTree>
+    void store(VesselTree& vt) const {
       vt.set_tree_flow(proper_ha_flow_.value()); 
       vt.set_cell_pressure(cell_pressure_.value());
-      RANGES_FOR(auto& cell, cells_ | ranges::view::values) {
+      for (auto& cell : cells_) {
         auto vtc = vt.add_macrocells();
         vtc->set_id(cell.id.value());
         vtc->set_x(cell.center.x.value());
@@ -119,10 +186,10 @@ namespace jhmi {
     }
     bool validate() const {
       bool all_good = true;
-      RANGES_FOR(auto& cell, cells_) {
-        auto& c = cell.second;
-        if (cell.first != c.id) {
-          fmt::print("Mismatch in cell id {} references {}\n", cell.first, c.id);
+      for (std::size_t pos = 0; pos < cells_.size(); ++pos) {
+        auto& c = cells_[pos];
+        if (!positions_.count(c.id) || positions_.at(c.id) != pos) {
+          fmt::print("Cell id {} not indexed at its position {}\n", c.id, pos);
           all_good = false;
         }
         if (!c.parent_vessel.valid()) {
@@ -134,6 +201,10 @@ namespace jhmi {
           all_good = false;
         }
       }
+      if (positions_.size() != cells_.size()) {
+        fmt::print("{} cell ids indexed for {} cells\n", positions_.size(), cells_.size());
+        all_good = false;
+      }
       return all_good;
     }
   };
@@ -0,0 +1,285 @@
+#ifndef JHMI_LIVER_CHUNKED_VESSEL_TREE_HPP_NRC_20261019
+#define JHMI_LIVER_CHUNKED_VESSEL_TREE_HPP_NRC_20261019
+
+#include "messages/vessel_tree.pb.h"
+#include "utility/load_protobuf.hpp"
+#include "utility/parallel_gzip_stream.hpp"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fmt/format.h>
+#include <tbb/tbb.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace jhmi {
+
+  //A vessel tree file made of separately gzipped VesselTree messages
+  // ("chunks") of a bounded number of vessels and macrocells each.  Merging
+  // the chunks in order gives the tree: the repeated fields are concatenated
+  // and the scalar ones are set in the last chunk.  Since no one message
+  // holds the whole tree, there's no limit on its size, and the chunks can
+  // be inflated and parsed in parallel.
+  //
+  //The file is a header, then each chunk preceded by its length, then an
+  // index of the chunks' offsets, then a trailer giving where the index
+  // starts.  Integers are 8 bytes (but for the header's) in the host's byte
+  // order.
+  namespace jhmi_detail {
+    constexpr char chunked_magic[8] = {'J','H','M','I','C','H','K','\n'};
+    constexpr char chunked_end_magic[8] = {'J','H','M','I','E','N','D','\n'};
+    constexpr std::uint32_t chunked_version = 1;
+
+    struct chunked_header {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t byte_order;//Reads back as 0x01020304 on the host that wrote it.
+    };
+    struct chunked_trailer {
+      std::uint64_t num_chunks;
+      std::uint64_t index_offset;
+      char magic[8];
+    };
+  }
+
+  inline bool is_chunked_vessel_tree(boost::filesystem::path const& filename) {
+    char magic[sizeof(jhmi_detail::chunked_magic)] = {};
+    std::ifstream f{filename.string(), std::ios::binary};
+    f.read(magic, sizeof(magic));
+    return f && std::memcmp(magic, jhmi_detail::chunked_magic, sizeof(magic)) == 0;
+  }
+
+  //Writes a chunked vessel tree file.  Has the parts of VesselTree's
+  // interface that fill one in, so code that stores a tree into a message
+  // can write it out instead, a chunk at a time.  Pointers from add_vessels
+  // and add_macrocells are good until the next call to either.  Until close
+  // is called the file has no index, so an unfinished file won't load.
+  class chunked_tree_writer {
+    boost::filesystem::path filename_;
+    std::ofstream file_;//Unused when writing to a caller's stream.
+    std::ostream& f_;
+    std::uint64_t start_;//Where the file starts in f_.
+    std::size_t chunk_size_;
+    jhmi_message::VesselTree chunk_;
+    jhmi_message::VesselTree values_;//Just the scalar fields.
+    std::vector<std::uint64_t> offsets_;
+    bool closed_;
+
+    template <typename T>
+    void write_raw(T const& t) { f_.write(reinterpret_cast<char const*>(&t), sizeof(T)); }
+    void flush_chunk() {
+      std::ostringstream zipped_stream;
+      {
+        parallel_gzip_stream gzip_stream{zipped_stream};
+        if (!chunk_.SerializeToZeroCopyStream(&gzip_stream) || !gzip_stream.Close())
+          throw std::runtime_error(fmt::format("Failed to write {}", filename_.string()));
+      }
+      auto zipped = zipped_stream.str();
+      offsets_.push_back(position());
+      write_raw(std::uint64_t(zipped.size()));
+      f_.write(zipped.data(), zipped.size());
+      chunk_.Clear();
+    }
+    std::uint64_t position() { return std::uint64_t(f_.tellp()) - start_; }
+    void write_header() {
+      auto header = jhmi_detail::chunked_header{};
+      std::memcpy(header.magic, jhmi_detail::chunked_magic, sizeof(header.magic));
+      header.version = jhmi_detail::chunked_version;
+      header.byte_order = 0x01020304;
+      write_raw(header);
+    }
+    void make_room() {
+      if (std::size_t(chunk_.vessels_size() + chunk_.macrocells_size()) >= chunk_size_)
+        flush_chunk();
+    }
+
+  public:
+    explicit chunked_tree_writer(boost::filesystem::path const& filename,
+                                 std::size_t chunk_size = 64 * 1024)
+      : filename_{filename}, file_{filename.string(), std::ios::binary}, f_{file_}, start_{0},
+        chunk_size_{std::max(chunk_size, std::size_t(1))}, closed_{false} {
+      if (!f_)
+        throw std::runtime_error(fmt::format("Unable to open {}", filename.string()));
+      write_header();
+    }
+    //Writes to out, e.g. from write_file_atomically; filename is only for
+    // error messages.  close leaves out open.
+    chunked_tree_writer(std::ostream& out, boost::filesystem::path const& filename,
+                        std::size_t chunk_size = 64 * 1024)
+      : filename_{filename}, f_{out}, start_{std::uint64_t(out.tellp())},
+        chunk_size_{std::max(chunk_size, std::size_t(1))}, closed_{false} {
+      if (!f_)
+        throw std::runtime_error(fmt::format("Unable to write {}", filename.string()));
+      write_header();
+    }
+    chunked_tree_writer(chunked_tree_writer const&) = delete;
+    chunked_tree_writer& operator=(chunked_tree_writer const&) = delete;
+
+    jhmi_message::Vessel* add_vessels() {
+      make_room();
+      return chunk_.add_vessels();
+    }
+    jhmi_message::Macrocell* add_macrocells() {
+      make_room();
+      return chunk_.add_macrocells();
+    }
+    void set_tree_flow(double tree_flow) { values_.set_tree_flow(tree_flow); }
+    void set_gamma(double gamma) { values_.set_gamma(gamma); }
+    void set_cell_pressure(double cell_pressure) { values_.set_cell_pressure(cell_pressure); }
+
+    //Writes the last chunk and the index.
+    void close() {
+      if (closed_)
+        return;
+      chunk_.set_tree_flow(values_.tree_flow());
+      chunk_.set_gamma(values_.gamma());
+      chunk_.set_cell_pressure(values_.cell_pressure());
+      flush_chunk();
+      auto index_offset = position();
+      for (auto offset : offsets_)
+        write_raw(offset);
+      auto trailer = jhmi_detail::chunked_trailer{offsets_.size(), index_offset, {}};
+      std::memcpy(trailer.magic, jhmi_detail::chunked_end_magic, sizeof(trailer.magic));
+      write_raw(trailer);
+      if (file_.is_open())
+        file_.close();
+      else
+        f_.flush();
+      if (!f_)
+        throw std::runtime_error(fmt::format("Failed to write {}", filename_.string()));
+      closed_ = true;
+    }
+  };
+
+  //Writes vt to a chunked file of chunk_size vessels or macrocells per chunk.
+  inline void write_chunked_vessel_tree(jhmi_message::VesselTree const& vt,
+                                        boost::filesystem::path const& filename,
+                                        std::size_t chunk_size = 64 * 1024) {
+    chunked_tree_writer out{filename, chunk_size};
+    for (auto const& v : vt.vessels())
+      *out.add_vessels() = v;
+    for (auto const& c : vt.macrocells())
+      *out.add_macrocells() = c;
+    out.set_tree_flow(vt.tree_flow());
+    out.set_gamma(vt.gamma());
+    out.set_cell_pressure(vt.cell_pressure());
+    out.close();
+  }
+
+  //A chunked vessel tree file, mapped read-only.
+  class chunked_vessel_tree {
+    boost::filesystem::path filename_;
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    std::vector<std::pair<std::uint64_t,std::uint64_t>> chunks_;//Offset and length of the zipped data.
+
+    char const* data() const { return static_cast<char const*>(region_.get_address()); }
+    template <typename T>
+    T read_raw(std::uint64_t offset) const {
+      T t;
+      std::memcpy(&t, data() + offset, sizeof(T));
+      return t;
+    }
+    [[noreturn]] void corrupt() const {
+      throw std::runtime_error(fmt::format("{} is truncated or corrupt", filename_.string()));
+    }
+
+  public:
+    explicit chunked_vessel_tree(boost::filesystem::path const& filename)
+      : filename_{filename}, file_{filename.string().c_str(), boost::interprocess::read_only},
+        region_{file_, boost::interprocess::read_only} {
+      using namespace jhmi_detail;
+      auto size = std::uint64_t(region_.get_size());
+      if (size < sizeof(chunked_header) + sizeof(chunked_trailer))
+        corrupt();
+      auto header = read_raw<chunked_header>(0);
+      if (std::memcmp(header.magic, chunked_magic, sizeof(chunked_magic)) != 0)
+        throw std::runtime_error(fmt::format("{} is not a chunked tree file", filename.string()));
+      if (header.version != chunked_version || header.byte_order != 0x01020304)
+        throw std::runtime_error(fmt::format("{} has an unsupported version or byte order", filename.string()));
+      auto trailer_offset = size - sizeof(chunked_trailer);
+      auto trailer = read_raw<chunked_trailer>(trailer_offset);
+      if (std::memcmp(trailer.magic, chunked_end_magic, sizeof(chunked_end_magic)) != 0
+          || trailer.index_offset > trailer_offset
+          || trailer.num_chunks != (trailer_offset - trailer.index_offset) / 8
+          || (trailer_offset - trailer.index_offset) % 8 != 0)
+        corrupt();
+      chunks_.reserve(trailer.num_chunks);
+      for (std::uint64_t i = 0; i < trailer.num_chunks; ++i) {
+        auto offset = read_raw<std::uint64_t>(trailer.index_offset + 8 * i);
+        if (offset < sizeof(chunked_header) || offset > trailer.index_offset - 8)
+          corrupt();
+        auto length = read_raw<std::uint64_t>(offset);
+        if (length > trailer.index_offset - offset - 8)
+          corrupt();
+        chunks_.emplace_back(offset + 8, length);
+      }
+    }
+
+    std::size_t num_chunks() const { return chunks_.size(); }
+    //Inflates and parses chunk i.  Safe to call concurrently.
+    jhmi_message::VesselTree chunk(std::size_t i) const {
+      namespace io = google::protobuf::io;
+      io::ArrayInputStream array_stream{data() + chunks_[i].first, int(chunks_[i].second)};
+      io::GzipInputStream gzip_stream{&array_stream};
+      jhmi_message::VesselTree vt;
+      if (!vt.ParseFromZeroCopyStream(&gzip_stream))
+        throw std::runtime_error(fmt::format("Invalid chunk {} in {}", i, filename_.string()));
+      return vt;
+    }
+  };
+
+  //Calls on_chunk with each chunk of ct, in order.  Chunks are parsed in
+  // parallel, a few per thread at a time, so only those need be held at once.
+  template <typename OnChunk>
+  void for_each_chunk(chunked_vessel_tree const& ct, OnChunk on_chunk) {
+    auto window = 4 * std::max(std::size_t(std::thread::hardware_concurrency()), std::size_t(1));
+    std::vector<jhmi_message::VesselTree> chunks;
+    for (std::size_t first = 0; first < ct.num_chunks(); first += window) {
+      auto n = std::min(window, ct.num_chunks() - first);
+      chunks.resize(n);
+      tbb::parallel_for(std::size_t(0), n, [&](std::size_t i) {
+        chunks[i] = ct.chunk(first + i);
+      });
+      for (auto& chunk : chunks)
+        on_chunk(chunk);
+    }
+  }
+
+  //The merged tree of a chunked file.
+  inline jhmi_message::VesselTree load_chunked_vessel_tree(boost::filesystem::path const& filename) {
+    jhmi_message::VesselTree vt;
+    for_each_chunk(chunked_vessel_tree{filename}, [&](jhmi_message::VesselTree& chunk) {
+      for (auto& v : *chunk.mutable_vessels())
+        *vt.add_vessels() = std::move(v);
+      for (auto& c : *chunk.mutable_macrocells())
+        *vt.add_macrocells() = std::move(c);
+      if (chunk.tree_flow() != 0)
+        vt.set_tree_flow(chunk.tree_flow());
+      if (chunk.gamma() != 0)
+        vt.set_gamma(chunk.gamma());
+      if (chunk.cell_pressure() != 0)
+        vt.set_cell_pressure(chunk.cell_pressure());
+    });
+    return vt;
+  }
+
+  //The tree in filename, whether chunked or a single gzipped VesselTree.
+  inline jhmi_message::VesselTree load_vessel_tree(boost::filesystem::path const& filename) {
+    return is_chunked_vessel_tree(filename) ? load_chunked_vessel_tree(filename)
+                                            : load_protobuf<jhmi_message::VesselTree>(filename);
+  }
+}//jhmi
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef JHMI_LIVER_COLUMNAR_TREE_HPP_NRC_20261019
+#define JHMI_LIVER_COLUMNAR_TREE_HPP_NRC_20261019
+
+#include "liver/macrocell.hpp"
+#include "liver/physical_vessel.hpp"
+#include "messages/vessel_tree.pb.h"
+#include "utility/binary_tree.hpp"
+#include "utility/write_file_atomically.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace jhmi {
+
+  //A vessel tree file laid out as one array per field, so it can be mapped
+  // into memory and read in place rather than parsed.  It holds what a
+  // VesselTree message does: vessels are stored in pre-order, with their
+  // parent and children given as positions in that order (-1 for none), and
+  // macrocells follow in their stored order.  Values are in SI units and the
+  // host's byte order.
+  //
+  //The file is a header, then each column in the order of the enums below,
+  // each starting on an 8 byte boundary.
+  enum class vessel_column { id, parent, left, right, cell, is_const,
+    radius, flow, entry_pressure, exit_pressure, sx, sy, sz, ex, ey, ez, count };
+  enum class cell_column { id, parent_vessel, idx_x, idx_y, idx_z,
+    x, y, z, radius, flow, pressure, count };
+
+  namespace jhmi_detail {
+    constexpr char columnar_magic[8] = {'J','H','M','I','C','O','L','\n'};
+    constexpr std::uint32_t columnar_version = 1;
+    constexpr std::size_t num_vessel_columns = std::size_t(vessel_column::count);
+    constexpr std::size_t num_cell_columns = std::size_t(cell_column::count);
+
+    struct columnar_header {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t byte_order;//Reads back as 0x01020304 on the host that wrote it.
+      std::uint64_t num_vessels;
+      std::uint64_t num_cells;
+      double gamma;
+      double tree_flow;
+      double cell_pressure;
+      std::uint64_t vessel_columns[num_vessel_columns];//Offsets from the start of the file.
+      std::uint64_t cell_columns[num_cell_columns];
+    };
+
+    //4 byte integers, except is_const, which is a byte; the rest are doubles.
+    inline std::size_t column_width(vessel_column c) {
+      return c == vessel_column::is_const ? 1 : c < vessel_column::radius ? 4 : 8;
+    }
+    inline std::size_t column_width(cell_column c) {
+      return c < cell_column::x ? 4 : 8;
+    }
+    inline std::size_t align_column(std::size_t offset) { return (offset + 7) & ~std::size_t(7); }
+  }
+
+  inline bool is_columnar_tree(boost::filesystem::path const& filename) {
+    char magic[sizeof(jhmi_detail::columnar_magic)] = {};
+    std::ifstream f{filename.string(), std::ios::binary};
+    f.read(magic, sizeof(magic));
+    return f && std::memcmp(magic, jhmi_detail::columnar_magic, sizeof(magic)) == 0;
+  }
+
+  //A columnar tree file, mapped read-only.
+  class columnar_tree {
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    jhmi_detail::columnar_header const* header_;
+
+    template <typename T>
+    T const* column(std::uint64_t offset) const {
+      return reinterpret_cast<T const*>(static_cast<char const*>(region_.get_address()) + offset);
+    }
+    template <typename T> T const* column(vessel_column c) const {
+      return column<T>(header_->vessel_columns[std::size_t(c)]);
+    }
+    template <typename T> T const* column(cell_column c) const {
+      return column<T>(header_->cell_columns[std::size_t(c)]);
+    }
+
+  public:
+    explicit columnar_tree(boost::filesystem::path const& filename)
+      : file_{filename.string().c_str(), boost::interprocess::read_only},
+        region_{file_, boost::interprocess::read_only}, header_{nullptr} {
+      using namespace jhmi_detail;
+      auto size = region_.get_size();
+      header_ = static_cast<columnar_header const*>(region_.get_address());
+      if (size < sizeof(columnar_header)
+          || std::memcmp(header_->magic, columnar_magic, sizeof(columnar_magic)) != 0)
+        throw std::runtime_error(fmt::format("{} is not a columnar tree file", filename.string()));
+      if (header_->version != columnar_version || header_->byte_order != 0x01020304)
+        throw std::runtime_error(fmt::format("{} has an unsupported version or byte order", filename.string()));
+      auto check = [&](std::uint64_t offset, std::size_t width, std::uint64_t n) {
+        if (offset % 8 != 0 || offset > size || n * width > size - offset)
+          throw std::runtime_error(fmt::format("{} is truncated or corrupt", filename.string()));
+      };
+      for (std::size_t c = 0; c < num_vessel_columns; ++c)
+        check(header_->vessel_columns[c], column_width(vessel_column(c)), header_->num_vessels);
+      for (std::size_t c = 0; c < num_cell_columns; ++c)
+        check(header_->cell_columns[c], column_width(cell_column(c)), header_->num_cells);
+    }
+
+    std::size_t num_vessels() const { return header_->num_vessels; }
+    std::size_t num_cells() const { return header_->num_cells; }
+    double gamma() const { return header_->gamma; }
+    double tree_flow() const { return header_->tree_flow; }
+    double cell_pressure() const { return header_->cell_pressure; }
+
+    //Positions in pre-order, or -1.
+    std::int32_t parent(std::size_t i) const { return column<std::int32_t>(vessel_column::parent)[i]; }
+    std::int32_t left(std::size_t i) const { return column<std::int32_t>(vessel_column::left)[i]; }
+    std::int32_t right(std::size_t i) const { return column<std::int32_t>(vessel_column::right)[i]; }
+    vessel_id id(std::size_t i) const { return vessel_id{column<std::int32_t>(vessel_column::id)[i]}; }
+
+    physical_vessel vessel(std::size_t i) const {
+      auto d = [&](vessel_column c) { return column<double>(c)[i]; };
+      auto v = physical_vessel{dbl3{d(vessel_column::sx), d(vessel_column::sy), d(vessel_column::sz)}*meters,
+                               dbl3{d(vessel_column::ex), d(vessel_column::ey), d(vessel_column::ez)}*meters,
+                               d(vessel_column::radius)*meters,
+                               cell_id{column<std::int32_t>(vessel_column::cell)[i]},
+                               d(vessel_column::flow) * boost::units::pow<3>(meters) / seconds,
+                               d(vessel_column::exit_pressure) * pascals,
+                               vessel_id{column<std::int32_t>(vessel_column::id)[i]},
+                               column<std::uint8_t>(vessel_column::is_const)[i] != 0};
+      v.entry_pressure_ = d(vessel_column::entry_pressure) * pascals;
+      return v;
+    }
+    macrocell cell(std::size_t i) const {
+      auto d = [&](cell_column c) { return column<double>(c)[i]; };
+      auto n = [&](cell_column c) { return column<std::int32_t>(c)[i]; };
+      return macrocell{dbl3{d(cell_column::x), d(cell_column::y), d(cell_column::z)}*meters,
+                       vessel_id{n(cell_column::parent_vessel)},
+                       cell_type::normal,
+                       d(cell_column::radius)*meters,
+                       cell_id{n(cell_column::id)},
+                       d(cell_column::flow)*boost::units::pow<3>(meters) / seconds,
+                       d(cell_column::pressure) * pascals,
+                       int3{n(cell_column::idx_x), n(cell_column::idx_y), n(cell_column::idx_z)}};
+    }
+  };
+
+  //Builds tree from ct's vessels, calling add_vessel on each node (in
+  // pre-order) as it's added.  Each vessel's parent precedes it, so no
+  // lookups by id or recursion are needed.
+  template <typename T, typename AddVessel>
+  void load_columnar_vessels(columnar_tree const& ct, binary_tree<T>& tree, AddVessel add_vessel) {
+    if (ct.num_vessels() == 0)
+      throw std::runtime_error("Columnar tree has no vessels");
+    std::vector<binary_node_t<T>> nodes;
+    nodes.reserve(ct.num_vessels());
+    tree = binary_tree<T>{T(ct.vessel(0))};
+    nodes.push_back(tree.root());
+    add_vessel(nodes.back());
+    for (std::size_t i = 1; i < ct.num_vessels(); ++i) {
+      auto p = ct.parent(i);
+      if (p < 0 || std::size_t(p) >= i)
+        throw std::runtime_error(fmt::format("Columnar vessel {} isn't in pre-order", i));
+      auto n = binary_node_t<T>{};
+      if (ct.left(p) == std::int32_t(i))
+        n = nodes[p].set_left_child(T(ct.vessel(i)));
+      else if (ct.right(p) == std::int32_t(i))
+        n = nodes[p].set_right_child(T(ct.vessel(i)));
+      else
+        throw std::runtime_error(fmt::format("Columnar vessel {} isn't a child of its parent {}", i, p));
+      nodes.push_back(n);
+      add_vessel(n);
+    }
+  }
+
+  //Converts a VesselTree, whose vessels may be in any order, to a columnar file.
+  inline void write_columnar_tree(jhmi_message::VesselTree const& vt,
+                                  boost::filesystem::path const& filename) {
+    using namespace jhmi_detail;
+    auto const& vs = vt.vessels();
+    std::unordered_map<std::int32_t, std::int32_t> by_id;
+    int root = -1;
+    for (int i = 0; i < vs.size(); ++i) {
+      if (!by_id.emplace(vs[i].id(), i).second)
+        throw std::runtime_error(fmt::format("VesselTree has more than one vessel {}", vs[i].id()));
+      if (!vessel_id{vs[i].parent()}.valid()) {
+        if (root != -1)
+          throw std::runtime_error("VesselTree has more than one root");
+        root = i;
+      }
+    }
+    //Message index of each vessel in pre-order, and each message's position.
+    // A child must name the vessel listing it as its parent and be reached
+    // only once, so cycles and shared children are rejected rather than
+    // followed.
+    std::vector<std::int32_t> order, position(vs.size(), -1);
+    if (root != -1) {
+      std::vector<char> reached(vs.size(), 0);
+      std::vector<std::int32_t> stack{root};
+      reached[root] = 1;
+      while (!stack.empty()) {
+        auto i = stack.back();
+        stack.pop_back();
+        position[i] = order.size();
+        order.push_back(i);
+        for (auto child : {vs[i].right(), vs[i].left()}) {
+          if (!vessel_id{child}.valid())
+            continue;
+          auto c = by_id.find(child);
+          if (c == by_id.end() || vs[c->second].parent() != vs[i].id() || reached[c->second])
+            throw std::runtime_error(fmt::format("VesselTree vessel {} has an invalid child {}", vs[i].id(), child));
+          reached[c->second] = 1;
+          stack.push_back(c->second);
+        }
+      }
+    }
+    if (order.size() != std::size_t(vs.size()))
+      throw std::runtime_error("VesselTree vessels don't form a single tree");
+    auto pos = [&](std::int32_t id) { return vessel_id{id}.valid() ? position[by_id.at(id)] : -1; };
+
+    columnar_header h{};
+    std::memcpy(h.magic, columnar_magic, sizeof(columnar_magic));
+    h.version = columnar_version;
+    h.byte_order = 0x01020304;
+    h.num_vessels = order.size();
+    h.num_cells = vt.macrocells_size();
+    h.gamma = vt.gamma();
+    h.tree_flow = vt.tree_flow();
+    h.cell_pressure = vt.cell_pressure();
+    auto offset = align_column(sizeof(h));
+    for (std::size_t c = 0; c < num_vessel_columns; ++c) {
+      h.vessel_columns[c] = offset;
+      offset = align_column(offset + h.num_vessels * column_width(vessel_column(c)));
+    }
+    for (std::size_t c = 0; c < num_cell_columns; ++c) {
+      h.cell_columns[c] = offset;
+      offset = align_column(offset + h.num_cells * column_width(cell_column(c)));
+    }
+
+    std::vector<char> buffer(offset);
+    std::memcpy(buffer.data(), &h, sizeof(h));
+    auto put = [&](std::uint64_t column, std::size_t i, auto value) {
+      std::memcpy(buffer.data() + column + i * sizeof(value), &value, sizeof(value));
+    };
+    auto vcol = [&](vessel_column c) { return h.vessel_columns[std::size_t(c)]; };
+    auto ccol = [&](cell_column c) { return h.cell_columns[std::size_t(c)]; };
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      auto const& v = vs[order[i]];
+      put(vcol(vessel_column::id), i, std::int32_t(v.id()));
+      put(vcol(vessel_column::parent), i, pos(v.parent()));
+      put(vcol(vessel_column::left), i, pos(v.left()));
+      put(vcol(vessel_column::right), i, pos(v.right()));
+      put(vcol(vessel_column::cell), i, std::int32_t(v.cell()));
+      put(vcol(vessel_column::is_const), i, std::uint8_t(v.is_const()));
+      put(vcol(vessel_column::radius), i, v.radius());
+      put(vcol(vessel_column::flow), i, v.flow());
+      put(vcol(vessel_column::entry_pressure), i, v.entry_pressure());
+      put(vcol(vessel_column::exit_pressure), i, v.exit_pressure());
+      put(vcol(vessel_column::sx), i, v.sx());
+      put(vcol(vessel_column::sy), i, v.sy());
+      put(vcol(vessel_column::sz), i, v.sz());
+      put(vcol(vessel_column::ex), i, v.ex());
+      put(vcol(vessel_column::ey), i, v.ey());
+      put(vcol(vessel_column::ez), i, v.ez());
+    }
+    for (int i = 0; i < vt.macrocells_size(); ++i) {
+      auto const& c = vt.macrocells(i);
+      put(ccol(cell_column::id), i, std::int32_t(c.id()));
+      put(ccol(cell_column::parent_vessel), i, std::int32_t(c.parent_vessel()));
+      put(ccol(cell_column::idx_x), i, std::int32_t(c.idx_x()));
+      put(ccol(cell_column::idx_y), i, std::int32_t(c.idx_y()));
+      put(ccol(cell_column::idx_z), i, std::int32_t(c.idx_z()));
+      put(ccol(cell_column::x), i, c.x());
+      put(ccol(cell_column::y), i, c.y());
+      put(ccol(cell_column::z), i, c.z());
+      put(ccol(cell_column::radius), i, c.radius());
+      put(ccol(cell_column::flow), i, c.flow());
+      put(ccol(cell_column::pressure), i, c.pressure());
+    }
+
+    if (!write_file_atomically(filename, [&](std::ostream& f) { f.write(buffer.data(), buffer.size()); }))
+      throw std::runtime_error(fmt::format("Failed to write {}", filename.string()));
+  }
+
+  //Converts a columnar file back to a VesselTree, with vessels in pre-order.
+  inline jhmi_message::VesselTree to_vessel_tree(columnar_tree const& ct) {
+    jhmi_message::VesselTree vt;
+    vt.set_gamma(ct.gamma());
+    vt.set_tree_flow(ct.tree_flow());
+    vt.set_cell_pressure(ct.cell_pressure());
+    auto id_at = [&](std::int32_t pos) {
+      return (pos < 0 ? vessel_id::invalid() : ct.id(pos)).value();
+    };
+    for (std::size_t i = 0; i < ct.num_vessels(); ++i) {
+      auto v = ct.vessel(i);
+      auto vtv = vt.add_vessels();
+      vtv->set_id(v.id().value());
+      vtv->set_parent(id_at(ct.parent(i)));
+      vtv->set_left(id_at(ct.left(i)));
+      vtv->set_right(id_at(ct.right(i)));
+      vtv->set_radius(v.radius().value());
+      vtv->set_cell(v.cell().value());
+      vtv->set_flow(v.flow().value());
+      vtv->set_entry_pressure(v.entry_pressure().value());
+      vtv->set_exit_pressure(v.exit_pressure().value());
+      vtv->set_sx(v.start().x.value());
+      vtv->set_sy(v.start().y.value());
+      vtv->set_sz(v.start().z.value());
+      vtv->set_ex(v.end().x.value());
+      vtv->set_ey(v.end().y.value());
+      vtv->set_ez(v.end().z.value());
+      vtv->set_is_const(v.is_const());
+    }
+    for (std::size_t i = 0; i < ct.num_cells(); ++i) {
+      auto c = ct.cell(i);
+      auto vtc = vt.add_macrocells();
+      vtc->set_id(c.id.value());
+      vtc->set_x(c.center.x.value());
+      vtc->set_y(c.center.y.value());
+      vtc->set_z(c.center.z.value());
+      vtc->set_radius(c.radius.value());
+      vtc->set_flow(c.flow.value());
+      vtc->set_pressure(c.pressure.value());
+      vtc->set_parent_vessel(c.parent_vessel.value());
+      vtc->set_idx_x(c.idx.x);
+      vtc->set_idx_y(c.idx.y);
+      vtc->set_idx_z(c.idx.z);
+    }
+    return vt;
+  }
+}//jhmi
+
+#endif
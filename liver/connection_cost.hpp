@@ -0,0 +1,42 @@
+#ifndef JHMI_LIVER_CONNECTION_COST_HPP_NRC_20261019
+#define JHMI_LIVER_CONNECTION_COST_HPP_NRC_20261019
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace jhmi {
+  //How a new cell picks among the vessels nearest it.  sampled draws one at
+  // random, balanced across z-layers.  volume and power solve the split point
+  // for every candidate and take the one adding the least vessel volume
+  // (radii following Murray's law with the tree's gamma) or the least
+  // Murray cost, pumping power plus the upkeep of blood volume.  Those two
+  // are experimental: each connection solves ten split points, one after
+  // another (bifurcation_batch::solve is a plain loop over them), and reads
+  // ten vessels' flows, and the cost over sampled hasn't been measured.
+  enum class connection_cost { sampled, volume, power };
+
+  inline std::istream& operator>>(std::istream& in, connection_cost& c) {
+    std::string s;
+    in >> s;
+    if (s == "sampled")
+      c = connection_cost::sampled;
+    else if (s == "volume")
+      c = connection_cost::volume;
+    else if (s == "power")
+      c = connection_cost::power;
+    else
+      in.setstate(std::ios::failbit);
+    return in;
+  }
+  inline std::ostream& operator<<(std::ostream& out, connection_cost c) {
+    switch (c) {
+      case connection_cost::sampled: return out << "sampled";
+      case connection_cost::volume: return out << "volume";
+      case connection_cost::power: return out << "power";
+    }
+    return out;
+  }
+}
+
+#endif
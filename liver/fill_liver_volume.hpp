@@ -8,8 +8,12 @@
 #include "shape/voxelized_shape.hpp"
 #include <boost/optional.hpp>
 #include <range/v3/algorithm.hpp>
+#include <tbb/tbb.h>
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <utility>
+#include <vector>
 
 namespace jhmi {
   namespace lobule {
@@ -81,6 +85,60 @@ namespace jhmi {
       }//x
     }//z
   }
+  //Specialization for voxelized shapes: rather than testing every lattice point
+  // in the bounding box, only points falling within the shape's runs of
+  // nonzero voxels are visited.  z-slabs are gathered in parallel, then f is
+  // called serially in the same order (and with the same coordinates) as above.
+  template <typename F>
+  void for_lobule(voxelized_shape const& shape, F f) {
+    using namespace lobule;
+    auto cube = extents(shape);
+    //Accumulate exactly as the generic loops do so coordinates match bit for bit.
+    std::vector<m> zs, xs, ys[2];
+    std::vector<int> izs, ixs, iys[2];
+    for (auto z = cube.ul().z + zoff; z < cube.lr().z; z += zstep) {
+      zs.push_back(z);
+      izs.push_back(shape.voxel(m3{cube.ul().x, cube.ul().y, z}).z);
+    }
+    for (auto x = cube.ul().x + xoff; x < cube.lr().x; x += xstep) {
+      xs.push_back(x);
+      ixs.push_back(shape.voxel(m3{x, cube.ul().y, cube.ul().z}).x);
+    }
+    for (int parity : {0, 1}) {
+      for (auto y = cube.ul().y + (parity == 0 ? yoff0 : yoff1); y < cube.lr().y; y += ystep) {
+        ys[parity].push_back(y);
+        iys[parity].push_back(shape.voxel(m3{cube.ul().x, y, cube.ul().z}).y);
+      }
+    }
+
+    using lattice_pt = std::pair<m3, int3>;
+    constexpr std::size_t slabs_per_batch = 64;
+    std::vector<std::vector<lattice_pt>> slabs(std::min(slabs_per_batch, zs.size()));
+    for (std::size_t zbegin = 0; zbegin < zs.size(); zbegin += slabs_per_batch) {
+      auto zend = std::min(zs.size(), zbegin + slabs_per_batch);
+      tbb::parallel_for(zbegin, zend, [&](std::size_t zidx) {
+        auto& slab = slabs[zidx - zbegin];
+        slab.clear();
+        for (std::size_t xidx = 0; xidx < xs.size(); ++xidx) {
+          auto const& iy = iys[xidx % 2];
+          RANGES_FOR(auto const& run, shape.runs(ixs[xidx], izs[zidx])) {
+            //iy is nondecreasing, so the lattice rows inside a run are contiguous.
+            auto it = std::lower_bound(iy.begin(), iy.end(), run.first);
+            for (; it != iy.end() && *it < run.second; ++it) {
+              auto yidx = int(it - iy.begin());
+              slab.emplace_back(m3{xs[xidx], ys[xidx % 2][yidx], zs[zidx]},
+                                int3{int(xidx), yidx, int(zidx)});
+            }
+          }
+        }
+      });
+      for (std::size_t zidx = zbegin; zidx < zend; ++zidx) {
+        for (auto const& lpt : slabs[zidx - zbegin])
+          f(lpt.first, lpt.second);
+      }
+    }
+  }
+
   template <typename Shape>
   auto lobules_in(Shape const& shape) {
     namespace rv = ranges::view;
@@ -172,6 +230,16 @@ namespace jhmi {
         f(mpt2, spt);
     });
   }
+  inline std::vector<m3> lobules_in(voxelized_shape const& shape) {
+    std::vector<m3> pts;
+    for_lobule(shape, [&](m3 const& pt, int3 const&) { pts.push_back(pt); });
+    return pts;
+  }
+  inline std::vector<m3> tracts_in(voxelized_shape const& shape) {
+    std::vector<m3> pts;
+    for_portal_tract(shape, [&](m3 const& pt, int3 const&) { pts.push_back(pt); });
+    return pts;
+  }
 #if 1
   template <typename Shape>
   auto tracts_in(Shape const& shape) {
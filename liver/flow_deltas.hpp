@@ -0,0 +1,204 @@
+#ifndef JHMI_LIVER_FLOW_DELTAS_HPP_NRC_20261019
+#define JHMI_LIVER_FLOW_DELTAS_HPP_NRC_20261019
+
+#include "utility/binary_tree.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace jhmi {
+
+  //Flow changes recorded rather than walked to the root; see
+  // physical_vessel_tree::set_deferred_flows.  A delta applies to every
+  // ancestor of the vessel it's recorded at, and to the vessel itself if
+  // inclusive.  Sequence numbers let a vessel skip deltas made before it
+  // existed (those at or below its base sequence).
+  //
+  //fold brings a vessel's flow up to date by applying the deltas below it at
+  // each vessel on their way up, in the order they were made, so flows are
+  // bitwise those eager updates give.  The deltas are then held at the
+  // folded vessel as passed: already applied there and below, but still owed
+  // to its ancestors.  No delta is applied at a vessel twice, so the folds
+  // of a cycle cost at most what its eager updates would have.
+  template <typename T>
+  class flow_deltas {
+    using node_t = binary_node_t<T>;
+    using flow_t = decltype(std::declval<T&>().flow_);
+
+  public:
+    struct delta {
+      std::uint64_t seq;
+      flow_t flow;
+      bool inclusive;
+    };
+
+  private:
+    std::uint64_t seq_ = 0;
+    std::vector<std::vector<delta>> pending_;//By vessel id; not yet applied.
+    std::vector<std::vector<delta>> passed_;
+    std::vector<std::uint64_t> base_seq_;
+    std::vector<char> below_;//Set on vessels with deltas at or below them.
+    std::vector<std::size_t> touched_;
+    //Scratch space for fold.
+    std::vector<std::pair<node_t, bool>> stack_;
+    std::vector<std::vector<delta>> lists_;
+
+    static bool by_seq(delta const& l, delta const& r) { return l.seq < r.seq; }
+    static std::size_t index(node_t n) { return std::size_t(n.value().id().value()); }
+    std::size_t slot(node_t n) {
+      auto i = index(n);
+      if (i >= below_.size()) {
+        auto size = std::max(i + 1, 2 * below_.size());
+        pending_.resize(size);
+        passed_.resize(size);
+        base_seq_.resize(size, 0);
+        below_.resize(size, 0);
+      }
+      touched_.push_back(i);
+      return i;
+    }
+    void add(node_t n, delta const& d) {
+      pending_[slot(n)].push_back(d);
+      for (; n && !below(n); n = n.parent())
+        below_[slot(n)] = 1;
+    }
+    //Both sorted; from is usually entirely later than to.
+    static void merge_into(std::vector<delta>& to, std::vector<delta> const& from) {
+      auto mid = to.size();
+      to.insert(to.end(), from.begin(), from.end());
+      if (mid != 0 && mid != to.size() && by_seq(to[mid], to[mid - 1]))
+        std::inplace_merge(to.begin(), to.begin() + mid, to.end(), by_seq);
+    }
+
+  public:
+    bool below(node_t n) const {
+      auto i = index(n);
+      return i < below_.size() && below_[i];
+    }
+    bool empty() const { return touched_.empty(); }
+
+    //Subtracts flow from n and all its ancestors.
+    void subtract(node_t n, flow_t flow) { add(n, delta{++seq_, flow, true}); }
+    //n was just added, with a flow that's current.
+    void record_new(node_t n) { base_seq_[slot(n)] = seq_; }
+    //parent was just put above child.
+    void insert_parent(node_t parent, node_t child) {
+      if (below(child))
+        below_[slot(parent)] = 1;
+    }
+    //Hands the deltas of a vessel being removed to the one which inherits its
+    // place in the tree, applying to it if inclusive.
+    void move(node_t from, node_t to, bool inclusive) {
+      auto f = slot(from);
+      auto moved = std::move(pending_[f]);
+      moved.insert(moved.end(), passed_[f].begin(), passed_[f].end());
+      pending_[f].clear();
+      passed_[f].clear();
+      below_[f] = 0;
+      for (auto d : moved) {
+        d.inclusive = inclusive;
+        add(to, d);
+      }
+    }
+
+    //n's flow as eager updates would have left it, without changing
+    // anything, so it's safe to call concurrently.  Costs as many deltas as
+    // there are below n; see fold.
+    flow_t flow(node_t n, std::vector<delta>& deltas, std::vector<node_t>& nodes) const {
+      auto flow = n.value().flow_;
+      if (!below(n))
+        return flow;
+      auto base = base_seq_[index(n)];
+      deltas.clear();
+      nodes.assign(1, n);
+      while (!nodes.empty()) {
+        auto u = nodes.back();
+        nodes.pop_back();
+        auto i = index(u);
+        for (auto const& d : pending_[i]) {
+          if (d.seq > base && (d.inclusive || !(u == n)))
+            deltas.push_back(d);
+        }
+        if (!(u == n)) {
+          for (auto const& d : passed_[i]) {
+            if (d.seq > base)
+              deltas.push_back(d);
+          }
+        }
+        if (u.left_child() && below(u.left_child()))
+          nodes.push_back(u.left_child());
+        if (u.right_child() && below(u.right_child()))
+          nodes.push_back(u.right_child());
+      }
+      std::sort(deltas.begin(), deltas.end(), by_seq);
+      for (auto const& d : deltas)
+        flow -= d.flow;
+      return flow;
+    }
+
+    //Applies the deltas below n to each vessel between where they were
+    // recorded and n, then returns n's flow.  Only deltas made since the
+    // last fold reaching them are visited.
+    flow_t fold(node_t n) {
+      if (!below(n))
+        return n.value().flow_;
+      //Post-order over the vessels with deltas below them.  Each expanded
+      // vessel's list starts as its own deltas, and its children's are merged
+      // in as they finish, marked inclusive since they all apply to it.
+      std::size_t top = 0;
+      stack_.assign(1, std::make_pair(n, false));
+      while (!stack_.empty()) {
+        auto [u, expanded] = stack_.back();
+        auto i = index(u);
+        if (!expanded) {
+          stack_.back().second = true;
+          if (lists_.size() == top)
+            lists_.emplace_back();
+          lists_[top].clear();
+          lists_[top].swap(pending_[i]);
+          if (!std::is_sorted(lists_[top].begin(), lists_[top].end(), by_seq))
+            std::stable_sort(lists_[top].begin(), lists_[top].end(), by_seq);
+          ++top;
+          if (u.left_child() && below(u.left_child()))
+            stack_.emplace_back(u.left_child(), false);
+          if (u.right_child() && below(u.right_child()))
+            stack_.emplace_back(u.right_child(), false);
+          continue;
+        }
+        stack_.pop_back();
+        auto& list = lists_[--top];
+        auto base = base_seq_[i];
+        for (auto& d : list) {
+          if (d.seq > base && d.inclusive)
+            u.value().flow_ -= d.flow;
+          d.inclusive = true;
+        }
+        merge_into(list, passed_[i]);
+        passed_[i].clear();
+        if (top == 0) {
+          passed_[i].swap(list);
+        }
+        else {
+          below_[i] = 0;
+          merge_into(lists_[top - 1], list);
+        }
+      }
+      return n.value().flow_;
+    }
+
+    //Forgets every delta, as when flows are about to be recomputed anyway.
+    void clear() {
+      for (auto i : touched_) {
+        pending_[i].clear();
+        passed_[i].clear();
+        base_seq_[i] = 0;
+        below_[i] = 0;
+      }
+      touched_.clear();
+      seq_ = 0;
+    }
+  };
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef JHMI_LIVER_LOAD_VESSEL_PROTOBUF_NRC_2016_02_10
 #define JHMI_LIVER_LOAD_VESSEL_PROTOBUF_NRC_2016_02_10
 
+#include "liver/parse_vessel.hpp"
 #include "messages/vessel_tree.pb.h"
 #include "utility/load_protobuf.hpp"
 #include <google/protobuf/io/coded_stream.h>
@@ -8,10 +9,8 @@
 #include <boost/filesystem.hpp>
 
 namespace jhmi {
-  auto load_vessel_protobuf(jhmi_message::VesselTree const& vt) {
-    vidx_to<jhmi_detail::flat_vessel> vns;
-    RANGES_FOR(auto&& vtv, vt.vessels()) {
-
+  namespace jhmi_detail {
+    inline flat_vessel to_flat_vessel(jhmi_message::Vessel const& vtv) {
       physical_vessel v{dbl3{vtv.sx(), vtv.sy(), vtv.sz()}*meters,
                              dbl3{vtv.ex(), vtv.ey(), vtv.ez()}*meters,
                              vtv.radius()*meters,
@@ -19,10 +18,15 @@ namespace jhmi {
                              vtv.flow() * boost::units::pow<3>(meters) / seconds,
                              vtv.exit_pressure() * pascals,
                              vessel_id{vtv.id()}, vtv.is_const()};
-      vessel_id parent{vtv.parent()};
-      vessel_id left{vtv.left()};
-      vessel_id right{vtv.right()};
-      vns.insert(std::make_pair(v.id(), jhmi_detail::flat_vessel{v, parent, left, right}));
+      return flat_vessel{v, vessel_id{vtv.parent()}, vessel_id{vtv.left()}, vessel_id{vtv.right()}};
+    }
+  }
+
+  auto load_vessel_protobuf(jhmi_message::VesselTree const& vt) {
+    vidx_to<jhmi_detail::flat_vessel> vns;
+    RANGES_FOR(auto&& vtv, vt.vessels()) {
+      auto fv = jhmi_detail::to_flat_vessel(vtv);
+      vns.insert(std::make_pair(fv.v.id(), fv));
     }
     return vns;
   }
@@ -2,23 +2,28 @@
 #define JHMI_LIVER_LOCATIONS_CELL_LOCATIONS_HPP_NRC_20160521
 
 #include "shape/voxelized_shape.hpp"
+#include "utility/philox.hpp"
 #include "utility/units.hpp"
 #include <random>
 #include <boost/optional.hpp>
+#include <vector>
 
 namespace jhmi {
   class cell_locations {
   public:
     virtual ~cell_locations() = default;
 
+    //Must be safe to call concurrently, as long as nothing is added or removed.
     virtual boost::optional<std::pair<m3,int3>> find_location(m3 const& loc,
       boost::optional<m3> const& end_loc,
-      std::mt19937& gen) const = 0;
+      philox4x32& gen) const = 0;
+    //Whether a location found earlier is still available.
+    virtual bool is_free(std::pair<m3,int3> const& loc) const = 0;
 
     virtual void add_item(macrocell const& m) = 0;
     virtual void remove_item(macrocell const& m) = 0;
-    virtual void reset(m cell_radius, cidx_to<macrocell> const& cells, bool fit_to_lobules) = 0;
-    virtual cubic_meters_per_second get_flow(std::mt19937* gen) const = 0;
+    virtual void reset(m cell_radius, std::vector<macrocell> const& cells, bool fit_to_lobules) = 0;
+    virtual cubic_meters_per_second get_flow(philox4x32* gen) const = 0;
     virtual int number_of_cells() const = 0;
   };
 }
@@ -0,0 +1,172 @@
+#ifndef JHMI_LIVER_LOCATIONS_FREE_SITE_INDEX_HPP_NRC_20261019
+#define JHMI_LIVER_LOCATIONS_FREE_SITE_INDEX_HPP_NRC_20261019
+
+#include "liver/fill_liver_volume.hpp"
+#include "utility/occupancy_grid.hpp"
+#include <boost/optional.hpp>
+#include <tbb/enumerable_thread_specific.h>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace jhmi {
+
+  //The potential cell locations of a lattice, with the unoccupied ones kept
+  // in uniform blocks so free sites near a point can be sampled directly.
+  // Within a block, sites are stored contiguously with the free ones first;
+  // occupying or freeing a site swaps it across that boundary in O(1).
+  class free_site_index {
+    struct site {
+      m3 loc;
+      int3 idx;
+      int layer;
+    };
+    occupancy_grid grid_;//Also tracks occupied indices which aren't sites.
+    cube<m3> ext_;
+    m block_size_;
+    int3 num_blocks_;
+    int min_layer_;
+    std::vector<site> sites_;//Ordered by grid id.
+    std::vector<std::uint32_t> order_;//Site ids grouped by block.
+    std::vector<std::uint32_t> position_;//Site id to its position in order_.
+    std::vector<std::uint32_t> block_begin_;
+    std::vector<std::uint32_t> block_free_;//Number of free sites in each block.
+    //Scratch space for sample_near, per thread so it may run concurrently.
+    struct sample_scratch {
+      std::vector<std::uint32_t> candidates;
+      std::vector<int> layer_counts;
+      std::vector<int> layers_seen;
+    };
+    std::size_t num_layers_;
+    mutable tbb::enumerable_thread_specific<sample_scratch> scratch_;
+
+    int3 block_of(m3 const& pt) const {
+      auto b = int3{floor(dbl3(element_divide(pt - ext_.ul(), dbl3{1,1,1} * block_size_)))};
+      return int3{std::min(std::max(b.x, 0), num_blocks_.x - 1),
+                  std::min(std::max(b.y, 0), num_blocks_.y - 1),
+                  std::min(std::max(b.z, 0), num_blocks_.z - 1)};
+    }
+    std::size_t block_id(int3 const& b) const {
+      return b.x + num_blocks_.x * (std::size_t(b.y) + std::size_t(num_blocks_.y) * b.z);
+    }
+    std::size_t block_of_site(std::uint32_t id) const { return block_id(block_of(sites_[id].loc)); }
+    void swap_positions(std::uint32_t pos1, std::uint32_t pos2) {
+      std::swap(order_[pos1], order_[pos2]);
+      position_[order_[pos1]] = pos1;
+      position_[order_[pos2]] = pos2;
+    }
+
+  public:
+    free_site_index(cube<int3> const& index_bounds, cube<m3> const& ext)
+      : grid_{index_bounds}, ext_{ext}, block_size_{1_mm}, num_blocks_{},
+        min_layer_(std::lround(ext.ul().z / lobule::cell_thickness) - 1),
+        num_layers_(std::lround(ext.lr().z / lobule::cell_thickness) - min_layer_ + 2) {}
+
+    //Replaces the set of sites, which may contain duplicates.  Occupancy is kept.
+    template <typename Sites>
+    void reset(Sites const& locs, m block_size) {
+      block_size_ = block_size;
+      num_blocks_ = int3{ceil(dbl3(element_divide(dimensions(ext_), dbl3{1,1,1} * block_size_)))}
+        + int3{1,1,1};
+      grid_.clear_sites();
+      for (auto&& l : locs)
+        grid_.add_site(l.second);
+      grid_.index_sites();
+      sites_.resize(grid_.num_sites());
+      for (auto&& l : locs) {
+        sites_[grid_.site_rank(l.second)] =
+          site{l.first, l.second, int(std::lround(l.first.z / lobule::cell_thickness))};
+      }
+
+      block_begin_.assign(std::size_t(num_blocks_.x) * num_blocks_.y * num_blocks_.z + 1, 0);
+      for (std::uint32_t id = 0; id < sites_.size(); ++id)
+        ++block_begin_[block_of_site(id) + 1];
+      for (std::size_t b = 1; b < block_begin_.size(); ++b)
+        block_begin_[b] += block_begin_[b-1];
+      block_free_.assign(block_begin_.size() - 1, 0);
+      order_.resize(sites_.size());
+      position_.resize(sites_.size());
+      //Place free sites at the front of each block, occupied ones at the back.
+      auto back = std::vector<std::uint32_t>(block_begin_.begin() + 1, block_begin_.end());
+      for (std::uint32_t id = 0; id < sites_.size(); ++id) {
+        auto b = block_of_site(id);
+        auto pos = grid_.is_occupied(sites_[id].idx) ? --back[b] : block_begin_[b] + block_free_[b]++;
+        order_[pos] = id;
+        position_[id] = pos;
+      }
+    }
+
+    bool is_occupied(int3 const& idx) const { return grid_.is_occupied(idx); }
+    bool any_free(cube<int3> const& idx_block) const { return grid_.any_free(idx_block); }
+
+    void occupy(int3 const& idx) {
+      if (grid_.is_occupied(idx))
+        return;
+      grid_.occupy(idx);
+      if (!grid_.is_site(idx))
+        return;
+      auto id = std::uint32_t(grid_.site_rank(idx));
+      auto b = block_of_site(id);
+      swap_positions(position_[id], block_begin_[b] + --block_free_[b]);
+    }
+    void release(int3 const& idx) {
+      if (!grid_.is_occupied(idx))
+        return;
+      grid_.release(idx);
+      if (!grid_.is_site(idx))
+        return;
+      auto id = std::uint32_t(grid_.site_rank(idx));
+      auto b = block_of_site(id);
+      swap_positions(position_[id], block_begin_[b] + block_free_[b]++);
+    }
+
+    //Draws a free site strictly within radius of pt.  Each z-layer (of
+    // lobule::cell_thickness) represented among those sites is equally likely,
+    // as is each site within the chosen layer; this matches weighting sites
+    // with make_balanced_sampler.  Safe to call concurrently, but not while
+    // the index changes.
+    template <typename Gen>
+    boost::optional<std::pair<m3,int3>> sample_near(m3 const& pt, m radius, Gen& gen) const {
+      if (sites_.empty())
+        return boost::none;
+      auto& [candidates, layer_counts, layers_seen] = scratch_.local();
+      layer_counts.resize(num_layers_, 0);
+      auto rsq = radius * radius;
+      auto lo = block_of(pt - dbl3{1,1,1} * radius);
+      auto hi = block_of(pt + dbl3{1,1,1} * radius);
+      candidates.clear();
+      for (int z = lo.z; z <= hi.z; ++z) {
+        for (int y = lo.y; y <= hi.y; ++y) {
+          for (int x = lo.x; x <= hi.x; ++x) {
+            auto b = block_id(int3{x,y,z});
+            for (auto pos = block_begin_[b]; pos < block_begin_[b] + block_free_[b]; ++pos) {
+              auto const& s = sites_[order_[pos]];
+              if (distance_squared(s.loc, pt) < rsq) {
+                candidates.push_back(order_[pos]);
+                if (layer_counts[s.layer - min_layer_]++ == 0)
+                  layers_seen.push_back(s.layer - min_layer_);
+              }
+            }
+          }
+        }
+      }
+      if (candidates.empty())
+        return boost::none;
+      auto layer = layers_seen[std::uniform_int_distribution<std::size_t>(0, layers_seen.size() - 1)(gen)];
+      auto nth = std::uniform_int_distribution<int>(0, layer_counts[layer] - 1)(gen);
+      for (auto l : layers_seen)
+        layer_counts[l] = 0;
+      layers_seen.clear();
+      for (auto id : candidates) {
+        auto const& s = sites_[id];
+        if (s.layer - min_layer_ == layer && nth-- == 0)
+          return std::make_pair(s.loc, s.idx);
+      }
+      assert(false);
+      return boost::none;
+    }
+  };
+}
+
+#endif
@@ -16,7 +16,7 @@ namespace jhmi {
     {}
 
     virtual boost::optional<std::pair<m3,int3>> find_location(m3 const& loc,
-        boost::optional<m3> const& end_loc, std::mt19937& gen) const override {
+        boost::optional<m3> const& end_loc, philox4x32& gen) const override {
       std::uniform_real_distribution<> dist{};
       auto rand = std::bind(dist, std::ref(gen));
       if (!liver_(loc)) {
@@ -39,6 +39,10 @@ namespace jhmi {
       return std::make_pair(near_loc, int3{});
     }
 
+    virtual bool is_free(std::pair<m3,int3> const& loc) const override {
+      return grid_(loc.first).empty();
+    }
+
     virtual void add_item(macrocell const& m) override {
       grid_.add_item(m);
     }
@@ -47,12 +51,12 @@ namespace jhmi {
       grid_.remove_item(m);
     }
 
-    virtual void reset(m cell_radius, cidx_to<macrocell> const& cells,
+    virtual void reset(m cell_radius, std::vector<macrocell> const& cells,
                        bool /*fit_to_lobules*/) override {
       cell_radius_ = cell_radius;
       auto new_grid = grid<cell_id>{extents(grid_), cell_radius_ / 2.};
       RANGES_FOR(auto& cell, cells)
-        new_grid.add_item(cell.second);
+        new_grid.add_item(cell);
       grid_ = std::move(new_grid);
     }
 
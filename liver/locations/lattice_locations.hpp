@@ -2,26 +2,32 @@
 #define JHMI_LIVER_LOCATIONS_LATTICE_LOCATIONS_HPP_NRC_20160521
 
 #include "liver/fill_liver_volume.hpp"
-#include "utility/make_balanced_sampler.hpp"
-#include "utility/octtree.hpp"
-#include <range/v3/action/remove_if.hpp>
-#include <unordered_set>
+#include "liver/locations/free_site_index.hpp"
+#include "liver/tract_lattice.hpp"
 
 namespace jhmi {
   namespace jhmi_detail {
-    struct potential_loc {
-      m3 loc;
-      int3 idx;
-    };
-    auto extents(potential_loc const& l) { return cube<m3>{l.loc, l.loc}; }
-    bool operator<(potential_loc const& lhs, potential_loc const& rhs) {
-      return lhs.idx < rhs.idx;
+    //All tract indices of a shape with these extents, plus a margin.
+    inline cube<int3> tract_index_bounds(cube<m3> const& ext) {
+      using namespace lobule;
+      auto n = int3{ceil(dbl3(element_divide(dimensions(ext), m3{xstep,ystep,zstep})))};
+      return {int3{-2,-2,-2}, int3{n.x + 3, 2 * n.y + 4, n.z + 3}};
     }
-    auto hash_value(potential_loc const& l) {
-      return boost::hash<int3>{}(l.idx);
-    }
-    auto distance_squared(potential_loc const& pl, m3 const& pt) {
-      return distance_squared(pl.loc, pt);
+    //The tract indices whose sites may lie within box, which is relative to
+    // the shape's extents.  Lobule (X,Y,Z) is at from_idx, and its tracts
+    // (y index 2Y and 2Y+1) are doff and dloff from it, so a tract's x is
+    // X*xstep + xoff less 0 or xstep, its y is from Y*ystep to
+    // Y*ystep + 2*side_length over both x parities, and its z is
+    // Z*zstep + zoff.  Bounds are widened by one index for the rounding in
+    // positions accumulated by for_lobule.
+    inline cube<int3> tract_indices_within(cube<m3> const& box) {
+      using namespace lobule;
+      auto first = [](m p, m step) { return int(std::ceil(p / step)) - 1; };
+      auto last = [](m p, m step) { return int(std::floor(p / step)) + 1; };
+      auto x0 = first(box.ul().x - xoff, xstep), x1 = last(box.lr().x - xoff, xstep) + 1;
+      auto y0 = first(box.ul().y - 2. * side_length, ystep), y1 = last(box.lr().y, ystep);
+      auto z0 = first(box.ul().z - zoff, zstep), z1 = last(box.lr().z - zoff, zstep);
+      return {int3{x0, 2 * y0, z0}, int3{x1 + 1, 2 * y1 + 2, z1 + 1}};
     }
   }
 
@@ -29,79 +35,75 @@ namespace jhmi {
     cube<m3> ext_;
     m cell_radius_;
     voxelized_shape const& liver_;
-    octtree<jhmi_detail::potential_loc> oct_;
-    std::unordered_set<int3, boost::hash<int3>> occupied_;
+    tract_lattice tracts_;
+    free_site_index free_;
+    std::vector<std::pair<m3,int3>> potential_locs_;//Reused by select_locations.
     double curr_num_acini_;
     double max_num_acini_;
     cubic_meters_per_second proper_ha_flow_;
 
     void select_locations(bool fit_to_lobules) {
-      auto new_oct = octtree<jhmi_detail::potential_loc>{extents(liver_)};
       auto ext = inflate(extents(liver_), -cell_radius_*dbl3{1,1,1});
       curr_num_acini_ = 0;
+      potential_locs_.clear();
       if (!fit_to_lobules) {
         traverse(ext, 2. * cell_radius_, [&](m3 const& pt) {
           auto nearest = find_near_tract(liver_, pt);
           if (nearest) {
-            new_oct.add_item(jhmi_detail::potential_loc{nearest->first, nearest->second});
+            potential_locs_.push_back(*nearest);
             ++curr_num_acini_;
           }
         });
       }
       else {
-        for_portal_tract(liver_, [&](m3 const& pt, int3 const& ipt) {
-          new_oct.add_item(jhmi_detail::potential_loc{pt, ipt});
+        tracts_.for_each([&](m3 const& pt, int3 const& ipt) {
+          potential_locs_.emplace_back(pt, ipt);
           ++curr_num_acini_;
         });
       }
-      oct_ = std::move(new_oct);
+      free_.reset(potential_locs_, 6. * cell_radius_);
     }
   public:
     lattice_locations(voxelized_shape const& liver, m cell_radius, cubic_meters_per_second proper_ha_flow)
-      : ext_{extents(liver)}, cell_radius_{cell_radius}, liver_{liver},
-        oct_{ext_}, occupied_{}, max_num_acini_{0}, proper_ha_flow_{proper_ha_flow} {
+      : ext_{extents(liver)}, cell_radius_{cell_radius}, liver_{liver}, tracts_{liver},
+        free_{jhmi_detail::tract_index_bounds(ext_), ext_}, max_num_acini_(tracts_.size()), proper_ha_flow_{proper_ha_flow} {
       select_locations(false);
-      int num_acini = 0;
-      for_portal_tract(liver_, [&](m3 const&, int3 const&) {
-        ++num_acini;
-      });
-      max_num_acini_ = num_acini;
     }
 
     virtual boost::optional<std::pair<m3,int3>> find_location(m3 const& loc,
           boost::optional<m3> const& end_loc,
-          std::mt19937& gen) const override {
+          philox4x32& gen) const override {
 
       if (end_loc) {
         auto fnt = find_near_tract(liver_, *end_loc);
-        if (!fnt || occupied_.find(fnt->second) != occupied_.end())
+        if (!fnt || free_.is_occupied(fnt->second))
           return boost::none;
         return *fnt;
       }
 
-      auto items = oct_.find_nearest_items(loc, 6. * cell_radius_)
-        | ranges::action::remove_if([&](jhmi_detail::potential_loc const& pl) {
-           return occupied_.find(pl.idx) != occupied_.end(); });
-      if (items.empty())
+      //Skip the search entirely if no potential location near loc is free.
+      auto radius = 6. * cell_radius_ * dbl3{1,1,1};
+      auto near = cube<m3>{loc - radius - ext_.ul(), loc + radius - ext_.ul()};
+      if (!free_.any_free(jhmi_detail::tract_indices_within(near)))
         return boost::none;
-      auto dist = make_balanced_sampler(items | ranges::view::transform([](auto&& pl) {
-        return int(std::lround(pl.loc.z / lobule::cell_thickness));
-      }) | ranges::to_vector);
-      auto& item = items[dist(gen)];
-      return std::make_pair(item.loc, item.idx);
+
+      return free_.sample_near(loc, 6. * cell_radius_, gen);
     }
 
+    virtual bool is_free(std::pair<m3,int3> const& loc) const override {
+      return !free_.is_occupied(loc.second);
+    }
     virtual void add_item(macrocell const& m) override {
-      occupied_.insert(m.idx);
+      free_.occupy(m.idx);
     }
     virtual void remove_item(macrocell const& m) override {
-      occupied_.erase(m.idx);
+      free_.release(m.idx);
     }
-    virtual void reset(m cell_radius, cidx_to<macrocell> const&, bool fit_to_lobules) override {
+    virtual void reset(m cell_radius, std::vector<macrocell> const&, bool fit_to_lobules) override {
       cell_radius_ = cell_radius;
       select_locations(fit_to_lobules);
     }
-    virtual cubic_meters_per_second get_flow(std::mt19937*) const override {
+    virtual cubic_meters_per_second get_flow(philox4x32*) const override {
       return cubic_meters_per_second{proper_ha_flow_ / max_num_acini_};
     }
     virtual int number_of_cells() const override {
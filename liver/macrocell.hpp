@@ -13,7 +13,7 @@
 #include <fstream>
 
 namespace jhmi {
-  template <typename T> using cidx_to = std::unordered_map<cell_id, T>;
+  template <typename T> using cidx_to = slot_map<cell_id, T>;
   enum class cell_type { normal, tumor };
   struct macrocell {
     m3 center;
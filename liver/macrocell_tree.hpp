@@ -2,54 +2,175 @@
 #define JHMI_LIVER_MACROCELL_TREE_HPP_NRC_20150803
 
 #include "liver/cell_list.hpp"
+#include "liver/chunked_vessel_tree.hpp"
 #include "liver/physical_vessel_tree.hpp"
+#include "liver/tree_snapshots.hpp"
+#include "liver/validation.hpp"
 #include "shape/voxelized_shape.hpp"
+#include "utility/bernoulli_skip.hpp"
 #include "utility/protobuf_zip_ostream.hpp"
+#include "utility/write_file_atomically.hpp"
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
 #include <boost/accumulators/statistics/rolling_mean.hpp>
 #include <boost/filesystem.hpp>
+#include <tbb/tbb.h>
 #include <chrono>
+#include <deque>
 #include <vector>
 
 namespace jhmi {
 
+  //The tree file a build checkpoint names, which sits beside it.  Empty for
+  // checkpoints that hold their tree themselves.
+  inline boost::filesystem::path checkpoint_tree_file(boost::filesystem::path const& checkpoint) {
+    auto cp = load_protobuf<jhmi_message::BuildCheckpoint>(checkpoint);
+    return cp.tree_file().empty() ? boost::filesystem::path{}
+                                  : checkpoint.parent_path() / cp.tree_file();
+  }
+  //A build checkpoint with its tree read in from the file it names.  The
+  // tree is read a chunk at a time, so it isn't subject to load_protobuf's
+  // size limit.
+  inline jhmi_message::BuildCheckpoint load_build_checkpoint(boost::filesystem::path const& checkpoint) {
+    auto cp = load_protobuf<jhmi_message::BuildCheckpoint>(checkpoint);
+    if (!cp.tree_file().empty())
+      *cp.mutable_tree() = load_vessel_tree(checkpoint.parent_path() / cp.tree_file());
+    return cp;
+  }
+  //Removes a build checkpoint and its tree file.
+  inline void remove_build_checkpoint(boost::filesystem::path const& checkpoint) {
+    if (!boost::filesystem::exists(checkpoint))
+      return;
+    auto tree_file = checkpoint_tree_file(checkpoint);
+    if (!tree_file.empty())
+      boost::filesystem::remove(tree_file);
+    boost::filesystem::remove(checkpoint);
+  }
+
   class macrocell_tree {
-    std::mt19937 gen_;
+    std::uint64_t seed_;
+    philox4x32 root_gen_;
+    //Each growth cycle draws from its own substream of root_gen_.
+    philox4x32 gen_;
+    std::uint64_t cycles_run_ = 0;
     voxelized_shape const& liver_;
     physical_vessel_tree vessels_;
     cell_list cells_;
+    validation validation_ = validation::full;
+    double validate_fraction_ = .05;
+    bool parallel_growth_ = false;
+    boost::filesystem::path checkpoint_;
+    bool delta_snapshots_ = false;
+    snapshot_writer snapshots_;
+    //Where a resumed build left off.
+    struct build_progress {
+      int next_cycle;
+      int cycles;
+      m final_radius;
+    };
+    boost::optional<build_progress> resume_from_;
 
-    int update_macrocells(float grow_prob, float die_prob) {
-      std::uniform_real_distribution<> dist;
-      auto rand = std::bind(dist, std::ref(gen_));
+    //Connects clones of the cells at centers, in order, as update_macrocells
+    // does, but finds sites and split points for a batch at a time in
+    // parallel against the tree as it stood when the batch began.  Each try
+    // of each clone draws from its own substream, keyed by the clone's index
+    // and the try, so the result doesn't depend on the number of threads.  A
+    // clone whose site has been taken, or whose vessel has been split, by an
+    // earlier clone in its batch is retried in a later one.
+    int connect_clones_in_parallel(std::vector<m3> const& centers) {
+      struct clone {
+        m3 center;
+        std::uint32_t index;
+        std::uint32_t tries;
+      };
+      struct proposal {
+        boost::optional<std::pair<m3,int3>> site;
+        cubic_meters_per_second flow;
+        boost::optional<physical_vessel_tree::planned_connection> plan;
+      };
+      const std::size_t batch_size = 256;
+      auto streams = gen_.substream(gen_());
+      std::deque<clone> pending;
+      for (std::uint32_t i = 0; i < centers.size(); ++i)
+        pending.push_back(clone{centers[i], i, 0});
+      std::vector<clone> batch;
+      std::vector<proposal> proposals;
+      int num_created = 0;
+      while (!pending.empty()) {
+        auto n = std::min(batch_size, pending.size());
+        batch.assign(pending.begin(), pending.begin() + n);
+        pending.erase(pending.begin(), pending.begin() + n);
+        proposals.assign(n, proposal{});
+        //Plans read flows concurrently, so they can't fold deferred ones;
+        // folding them all first makes those reads O(1).
+        vessels_.apply_pending_flows();
+        tbb::parallel_for(std::size_t(0), n, [&](std::size_t i) {
+          auto gen = streams.substream(batch[i].index, batch[i].tries);
+          auto& p = proposals[i];
+          p.site = cells_.propose_location(batch[i].center, gen);
+          if (!p.site)
+            return;
+          p.flow = cells_.propose_flow(gen);
+          p.plan = vessels_.plan_connection(p.site->first, p.flow, gen);
+        });
+        for (std::size_t i = 0; i < n; ++i) {
+          auto const& p = proposals[i];
+          if (!p.site)
+            continue;
+          if (!cells_.is_free(*p.site)) {
+            ++batch[i].tries;
+            pending.push_back(batch[i]);
+            continue;
+          }
+          auto new_id = cells_.add_cell_at(*p.site, p.flow);
+          if (vessels_.connect_cell(cells_.at(new_id), *p.plan).valid()) {
+            ++num_created;
+          }
+          else {
+            cells_.erase(new_id);
+            ++batch[i].tries;
+            pending.push_back(batch[i]);
+          }
+        }
+      }
+      return num_created;
+    }
 
+    int update_macrocells(float grow_prob, float die_prob) {
+      //Each cell dies with die_prob and clones with grow_prob; skipping
+      // between the chosen cells draws only as many variates as are chosen.
+      auto cells = cells_.list() | ranges::view::transform([](macrocell const& c) { return &c; })
+        | ranges::to_vector;
       //Determine which cells die
       std::vector<cell_id> dying;
-      RANGES_FOR(auto& cell, cells_.list()) {
-        if (rand() < die_prob && vessels_.remove(cell.parent_vessel))
-          dying.push_back(cell.id);
-      }
+      for_each_bernoulli(cells.size(), die_prob, gen_, [&](std::size_t i) {
+        if (vessels_.remove(cells[i]->parent_vessel))
+          dying.push_back(cells[i]->id);
+      });
       //For each mc (in random order) attempt to fill empty spaces;
       std::vector<m3> clone_cells;
-      RANGES_FOR(auto& cell, cells_.list()) {
-        if (rand() < grow_prob)
-          clone_cells.push_back(cell.center);
-      }
+      for_each_bernoulli(cells.size(), grow_prob, gen_, [&](std::size_t i) {
+        clone_cells.push_back(cells[i]->center);
+      });
       int num_died = dying.size();
       RANGES_FOR(auto id, dying) {
         cells_.erase(id);
       }
       ranges::shuffle(clone_cells, gen_);
       int num_created = 0;
-      RANGES_FOR(auto center, clone_cells) {
-        auto new_id = cells_.add_cell_near(center);
-        if (new_id.valid()) {
-          if (vessels_.connect_cell(cells_.at(new_id), gen_).valid()) {
-            ++num_created;
+      if (parallel_growth_) {
+        num_created = connect_clones_in_parallel(clone_cells);
+      }
+      else {
+        RANGES_FOR(auto center, clone_cells) {
+          auto new_id = cells_.add_cell_near(center);
+          if (new_id.valid()) {
+            if (vessels_.connect_cell(cells_.at(new_id), gen_).valid()) {
+              ++num_created;
+            }
+            else
+              cells_.erase(new_id);
           }
-          else
-            cells_.erase(new_id);
         }
       }
 #define PER_SUBCYCLE
@@ -80,16 +201,30 @@ namespace jhmi {
       //If we're solving for flow, we need to update the cell values afterward
     }
 
+    macrocell_tree(resume_build_tag, jhmi_message::BuildCheckpoint const& cp,
+                   voxelized_shape const& liver)
+      : seed_{cp.seed()}, root_gen_{seed_}, gen_{root_gen_}, cycles_run_{cp.cycles_run()},
+        liver_{liver}, vessels_{resume_build, cp, extents(liver_), gen_},
+        cells_{resume_build, cp, liver_, gen_},
+        resume_from_{build_progress{cp.next_cycle(), cp.cycles(), cp.final_radius() * meters}} {
+      vessels_.set_deferred_flows(cp.deferred_flows());
+      parallel_growth_ = cp.parallel_growth();
+      vessels_.set_connection_cost(connection_cost(cp.connection_cost()));
+    }
+
   public:
     static m initial_size() { return 5_mm / .3679; }
     macrocell_tree(build_tree_tag, boost::filesystem::path const& vesselfile,
                    voxelized_shape const& liver,
                    std::random_device::result_type seed,
                    cubic_meters_per_second proper_ha_flow,
-                   double gamma, Pa cell_pressure, bool initial_fill = true)
-      : gen_{seed}, liver_{liver},
+                   double gamma, Pa cell_pressure, bool initial_fill = true,
+                   bool defer_flows = true)
+      : seed_{seed}, root_gen_{seed}, gen_{root_gen_}, liver_{liver},
         vessels_{build_tree, vesselfile, extents(liver_), gamma, cell_pressure, proper_ha_flow / 1868346., gen_},
         cells_{build_tree, gen_, liver_, initial_size(), proper_ha_flow, cell_pressure} {
+      //Every cycle ends with normalize_all, so flow updates needn't be eager.
+      vessels_.set_deferred_flows(defer_flows);
       //We now add macrocells to each terminal vessel in the liver model.
       auto terminal_vessels = vessels_.terminal_vessels() | ranges::to_vector;
       for (auto&& v : terminal_vessels) {
@@ -108,23 +243,117 @@ namespace jhmi {
     }
     macrocell_tree(load_tree_tag, boost::filesystem::path const& treefile,
           voxelized_shape const& liver = voxelized_shape{})
-      : gen_{0}, liver_{liver}, vessels_{load_tree, treefile, gen_},
+      : seed_{0}, root_gen_{0}, gen_{root_gen_}, liver_{liver}, vessels_{load_tree, treefile, gen_},
         cells_{load_tree, treefile, liver, gen_} {
       //Takes a really long time, not strictly necessary
       //validate();
     }
+    //Continues the build saved in a checkpoint; see set_checkpoint.  Calling
+    // build with the same cycles and final radius finishes it.
+    macrocell_tree(resume_build_tag, boost::filesystem::path const& checkpoint,
+                   voxelized_shape const& liver)
+      : macrocell_tree{resume_build, load_build_checkpoint(checkpoint), liver} {}
 
     auto const& macrocells() const { return cells_; }
+    void verify_normalize(bool verify) { vessels_.verify_normalize(verify); }
+    //Whether growth cycles connect new cells with connect_clones_in_parallel.
+    // The tree differs from a sequential build's, but is the same for a given
+    // seed however many threads run.
+    // A resumed build keeps the setting (as it does the connection cost)
+    // its checkpoint was saved with.
+    void set_parallel_growth(bool parallel) { parallel_growth_ = parallel; }
+    bool parallel_growth() const { return parallel_growth_; }
+    //How growth cycles pick the vessel a new cell connects to.
+    void set_connection_cost(connection_cost cost) { vessels_.set_connection_cost(cost); }
+    connection_cost current_connection_cost() const { return vessels_.current_connection_cost(); }
+    //How build checks the tree after each cycle; see validation.
+    void set_validation(validation v, double sampled_fraction = .05) {
+      validation_ = v;
+      validate_fraction_ = sampled_fraction;
+    }
+    //Where build saves its state after each cycle but the last, so that an
+    // interrupted build can be resumed and give the same tree.  Empty (the
+    // default) to not save it.
+    void set_checkpoint(boost::filesystem::path const& checkpoint) { checkpoint_ = checkpoint; }
+    //Whether build writes each cycle's snapshot after the first as only the
+    // changes since the one before; see tree_snapshots.hpp.  The first
+    // snapshot a build (or resumed build) writes is always in full.
+    void set_delta_snapshots(bool delta) { delta_snapshots_ = delta; }
     physical_vessel_tree const& vessel_tree() const { return vessels_; }
 
+    //Writes a chunked vessel tree file.
     void write(boost::filesystem::path const& filename) const {
-      namespace io = google::protobuf::io;
+      chunked_tree_writer out{filename};
+      vessels_.store(out);
+      cells_.store(out);
+      out.close();
+    }
+    //A per-cycle snapshot: in full, or as a delta to a file named for
+    // filename by delta_snapshot_file.
+    void write_snapshot(boost::filesystem::path const& filename) {
+      if (!delta_snapshots_) {
+        write(filename);
+        return;
+      }
+      jhmi_message::VesselTree vt;
+      vessels_.store(vt);
+      cells_.store(vt);
+      if (snapshots_.has_base())
+        snapshots_.write_delta(std::move(vt), delta_snapshot_file(filename));
+      else
+        snapshots_.write_full(std::move(vt), filename);
+    }
+    //As write, but in the columnar format, which loads without parsing.
+    void write_columnar(boost::filesystem::path const& filename) const {
       jhmi_message::VesselTree vt;
       vessels_.store(vt);
       cells_.store(vt);
-      protobuf_zip_ostream out_stream{filename};
-      if (!vt.SerializeToZeroCopyStream(out_stream.get()))
-        throw std::runtime_error("Failed to write macrocell tree.");
+      write_columnar_tree(vt, filename);
+    }
+    //Writes the tree as a chunked file beside filename, then the rest as a
+    // small checkpoint naming it, so no single message need hold the tree.
+    // Both go through write_file_atomically, and the previous tree file is
+    // removed only after the checkpoint no longer names it, so an
+    // interruption while writing leaves the previous checkpoint.
+    void write_checkpoint(boost::filesystem::path const& filename,
+                          int next_cycle, int cycles, m final_radius) const {
+      auto tree_file = filename;
+      tree_file += fmt::format(".{:02}.tree", next_cycle);
+      auto wrote_tree = write_file_atomically(tree_file, [&](std::ostream& f) {
+        chunked_tree_writer out{f, tree_file};
+        vessels_.store(out);
+        cells_.store(out);
+        out.close();
+      });
+      if (!wrote_tree)
+        throw std::runtime_error(fmt::format("Failed to write {}", tree_file.string()));
+
+      auto previous_tree = boost::filesystem::path{};
+      if (boost::filesystem::exists(filename))
+        previous_tree = checkpoint_tree_file(filename);
+      jhmi_message::BuildCheckpoint cp;
+      cp.set_tree_file(tree_file.filename().string());
+      cp.set_seed(seed_);
+      cp.set_cycles_run(cycles_run_);
+      cp.set_next_cycle(next_cycle);
+      cp.set_cycles(cycles);
+      cp.set_final_radius(final_radius.value());
+      cp.set_cell_radius(cells_.cell_radius().value());
+      cp.set_cell_flow(vessels_.cell_flow().value());
+      cp.set_last_vessel_id(vessels_.last_vessel_id().value());
+      cp.set_last_cell_id(cells_.last_cell_id().value());
+      cp.set_deferred_flows(vessels_.deferred_flows());
+      cp.set_parallel_growth(parallel_growth_);
+      cp.set_connection_cost(int(vessels_.current_connection_cost()));
+      auto wrote_checkpoint = write_file_atomically(filename, [&](std::ostream& f) {
+        parallel_gzip_stream out_stream{f};
+        if (!cp.SerializeToZeroCopyStream(&out_stream) || !out_stream.Close())
+          f.setstate(std::ios::badbit);
+      });
+      if (!wrote_checkpoint)
+        throw std::runtime_error("Failed to write build checkpoint.");
+      if (!previous_tree.empty() && previous_tree != tree_file)
+        boost::filesystem::remove(previous_tree);
     }
     auto const& liver_shape() const { return liver_; }
 
@@ -137,7 +366,18 @@ namespace jhmi {
                std::string const& filestem = "") {
       float m1 = 1.f, m2 = 9.8f, n1 = .3f, n2 = 9.f;
       auto t = (final_radius - macrocell_tree::initial_size()) / double(cycles);
-      RANGES_FOR(int cycle, ranges::view::ints(0, cycles)) {
+      int first_cycle = 0;
+      if (resume_from_) {
+        if (resume_from_->cycles != cycles || resume_from_->final_radius != final_radius) {
+          throw std::runtime_error(fmt::format(
+            "Checkpoint was saved building {} cycles to {} m, not {} cycles to {} m",
+            resume_from_->cycles, resume_from_->final_radius.value(), cycles, final_radius.value()));
+        }
+        first_cycle = resume_from_->next_cycle;
+        resume_from_ = boost::none;
+      }
+      RANGES_FOR(int cycle, ranges::view::ints(first_cycle, cycles)) {
+        gen_ = root_gen_.substream(cycles_run_++);
         auto grow_prob = m1 * expf(-cycle / m2);
         auto die_prob = n1 * expf(-cycle / n2);
         bool fit_to_lobules = cycle == cycles - 1 && final_radius < 2_mm;
@@ -150,7 +390,8 @@ namespace jhmi {
         vessels_.normalize_all();
         auto stop = std::chrono::high_resolution_clock::now();
         auto end_num_cells = ranges::size(macrocells().list());
-        if (!validate()) {
+        if (validation_ != validation::off
+            && !validate(validation_ == validation::sampled ? validate_fraction_ : 1., cycle)) {
           fmt::print("Invalid tree detected!\n");
         }
 #if 1
@@ -159,8 +400,10 @@ namespace jhmi {
           std::chrono::duration<float>(stop - start).count());
 #endif
         if (!filestem.empty() && cycle < cycles - 1) {
-          write(p / fmt::format(filestem, cycle));
+          write_snapshot(p / fmt::format(filestem, cycle));
         }
+        if (!checkpoint_.empty() && cycle < cycles - 1)
+          write_checkpoint(checkpoint_, cycle + 1, cycles, final_radius);
       }
 
       auto start = std::chrono::high_resolution_clock::now();
@@ -168,27 +411,72 @@ namespace jhmi {
       vessels_.normalize_all();
       auto stop = std::chrono::high_resolution_clock::now();
       fmt::print("Time to normalize: {} s\n", std::chrono::duration<float>(stop - start).count());
+      if (validation_ == validation::sampled && !validate()) {
+        fmt::print("Invalid tree detected!\n");
+      }
     }
 
-    bool validate() const {
-      bool no_errors = vessels_.validate(ranges::empty(cells_.list())) && cells_.validate();
+    //Checks the whole tree, or with fraction < 1 a sample of its vessels and
+    // cells, each chosen with that probability using sample_seed.
+    bool validate(double fraction = 1., std::uint32_t sample_seed = 0) const {
+      bool no_errors = vessels_.validate(ranges::empty(cells_.list()), fraction, sample_seed)
+        && cells_.validate();
+      auto cells = cells_.list() | ranges::view::transform([](macrocell const& c) { return &c; })
+        | ranges::to_vector;
+      if (fraction < 1. && !cells.empty()) {
+        philox4x32 gen{sample_seed};
+        decltype(cells) sample;
+        for_each_bernoulli(cells.size(), fraction, gen, [&](std::size_t i) { sample.push_back(cells[i]); });
+        cells = std::move(sample);
+      }
       //Verify each cell matches the exit pressure and flow of the parent_vessel
-      RANGES_FOR(auto& cell, cells_.list()) {
+      using failures = std::vector<std::size_t>;
+      auto failed = tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, cells.size(), 1024), failures{},
+        [&](tbb::blocked_range<std::size_t> const& r, failures f) {
+          for (auto i = r.begin(); i != r.end(); ++i) {
+            auto& v = vessels_.at(cells[i]->parent_vessel);
+            double diff = std::abs(2. * (v.exit_pressure() - cells[i]->pressure)
+                                      / (v.exit_pressure() + cells[i]->pressure));
+            if (diff > 1e-4)
+              f.push_back(i);
+          }
+          return f;
+        },
+        [](failures l, failures const& r) {
+          l.insert(l.end(), r.begin(), r.end());
+          return l;
+        });
+      ranges::sort(failed);
+      for (auto i : failed) {
+        auto& cell = *cells[i];
         auto& v = vessels_.at(cell.parent_vessel);
 //        no_errors &= check_close(v.flow(), cell.flow, 1e-8, v.id(),
 //          "vessel flow", "cell flow");
-        no_errors &= check_close(v.exit_pressure(), cell.pressure, 1e-4, v.id(),
+        check_close(v.exit_pressure(), cell.pressure, 1e-4, v.id(),
           "vessel exit pressure", "cell pressure");
       }
-      RANGES_FOR(auto& vessel, vessels_.vessels()) {
-        try {
-          if (vessel.cell().valid())
-            cells_.at(vessel.cell());
-        }
-        catch(std::exception& e) {
+      no_errors &= failed.empty();
+      if (fraction >= 1.) {
+        auto vessel_cells = vessels_.vessels()
+          | ranges::view::transform([](physical_vessel const& v) { return v.cell(); })
+          | ranges::view::filter([](cell_id id) { return id.valid(); })
+          | ranges::to_vector;
+        auto missing = tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, vessel_cells.size(), 1024), 0,
+          [&](tbb::blocked_range<std::size_t> const& r, int count) {
+            for (auto i = r.begin(); i != r.end(); ++i) {
+              try {
+                cells_.at(vessel_cells[i]);
+              }
+              catch(std::exception&) {
+                ++count;
+              }
+            }
+            return count;
+          },
+          std::plus<int>{});
+        for (int i = 0; i < missing; ++i)
           fmt::print("Vessel references non-existent cell\n");
-          no_errors = false;
-        }
+        no_errors &= missing == 0;
       }
       if (!no_errors)
         fmt::print("Errors found in tree\n");
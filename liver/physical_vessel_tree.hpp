@@ -1,19 +1,30 @@
 #ifndef JHMI_LIVER_PHYSICAL_VESSEL_TREE_HPP_NRC_20150831
 #define JHMI_LIVER_PHYSICAL_VESSEL_TREE_HPP_NRC_20150831
 
+#include "liver/bifurcation_batch.hpp"
 #include "liver/build_vessel_map.hpp"
+#include "liver/columnar_tree.hpp"
+#include "liver/connection_cost.hpp"
 #include "liver/get_split_point.hpp"
 #include "liver/load_vessel_protobuf.hpp"
 #include "liver/distance_vessel.hpp"
+#include "liver/flow_deltas.hpp"
 #include "liver/physical_vessel.hpp"
 #include "liver/physical_vessel_tree_updater.hpp"
+#include "liver/stream_vessel_tree.hpp"
+#include "liver/tree_hash.hpp"
+#include "utility/bernoulli_skip.hpp"
 #include "utility/binary_tree.hpp"
 #include "utility/line.hpp"
+#include "utility/make_balanced_sampler.hpp"
 #include "utility/octtree.hpp"
+#include "utility/philox.hpp"
+#include <boost/dynamic_bitset.hpp>
 #include <boost/filesystem.hpp>
-#include <range/v3/algorithm/equal.hpp>
 #include <range/v3/view.hpp>
-#include <set>
+#include <tbb/tbb.h>
+#include <algorithm>
+#include <cstdint>
 
 namespace jhmi {
   class physical_vessel_tree {
@@ -23,6 +34,21 @@ namespace jhmi {
     octtree<distance_vessel> grid_;
     physical_vessel_tree_updater vessel_updater_;
     double gamma_;
+    connection_cost connection_cost_ = connection_cost::sampled;
+
+    //Flow changes recorded in deferred mode, see set_deferred_flows.
+    bool defer_flows_ = false;
+    flow_deltas<physical_vessel> flow_deltas_;
+    //Scratch space for plan_connection.
+    struct connection_scratch {
+      balanced_sampler sampler;
+      std::vector<int> layers;
+      std::vector<flow_deltas<physical_vessel>::delta> deltas;
+      std::vector<binary_node_t<physical_vessel>> nodes;
+      std::vector<physical_vessel> candidates;
+      bifurcation_batch batch;
+    };
+    connection_scratch connection_scratch_;
 
     struct forward_distance_squared {
       auto operator()(distance_vessel const& sv, m3 const& pt) -> boost::optional<decltype(pt.x*pt.x)> {
@@ -34,14 +60,17 @@ namespace jhmi {
       }
     };
 
-    auto get_nearest_vessel(m3 const& loc, std::mt19937& gen) {
+    vessel_id get_nearest_vessel_id(m3 const& loc, philox4x32& gen,
+        balanced_sampler& sampler, std::vector<int>& layers) const {
       //Randomly select one item of many
       auto items = grid_.find_n_nearest_items(loc, 10, forward_distance_squared());
       assert(!items.empty());
 #if 1
-      auto dist = make_balanced_sampler(items | ranges::view::transform([&](distance_vessel const& sv) {
-        return int(std::lround(sv.l.p2.z / lobule::cell_thickness));
-      }) | ranges::to_vector);
+      layers.clear();
+      for (auto&& sv : items)
+        layers.push_back(int(std::lround(sv.l.p2.z / lobule::cell_thickness)));
+      auto& dist = sampler;
+      dist.reset(layers);
 #else
 #if 1
       auto w = items | ranges::view::transform([&](distance_vessel const& sv) {
@@ -52,7 +81,7 @@ namespace jhmi {
       std::uniform_int_distribution<> dist(0, items.size() - 1);
 #endif
 #endif
-      return to_vessels_.at(items[dist(gen)].id);
+      return items[dist(gen)].id;
     }
 
     void record_vessel(binary_node_t<physical_vessel> node) {
@@ -60,28 +89,73 @@ namespace jhmi {
       to_vessels_.insert(std::make_pair(node.value().id(), node));
     }
 
-    vessel_id split_existing_vessel(binary_node_t<physical_vessel> node, macrocell& cell) {
+    //Subtracts flow from n and all its ancestors, now or (when deferred) lazily.
+    void subtract_flow(binary_node_t<physical_vessel> n, cubic_meters_per_second flow) {
+      if (!defer_flows_) {
+        for (; n; n = n.parent())
+          n.value().flow_ -= flow;
+        return;
+      }
+      flow_deltas_.subtract(n, flow);
+    }
+    void record_new_vessel(binary_node_t<physical_vessel> n) {
+      if (defer_flows_)
+        flow_deltas_.record_new(n);
+      record_vessel(n);
+    }
+    //Moves the deltas of a vessel being removed to the one which inherits its
+    // place in the tree.
+    void move_flow_deltas(binary_node_t<physical_vessel> from,
+                          binary_node_t<physical_vessel> to, bool inclusive) {
+      if (defer_flows_)
+        flow_deltas_.move(from, to, inclusive);
+    }
+    //The flow eager updates would have left in n, bitwise.  The const form
+    // leaves the deltas where they are, so it's safe to call concurrently,
+    // but pays for every delta below n on each call; the other folds them up
+    // to n, so each is only applied once per vessel it reaches.
+    cubic_meters_per_second current_flow(binary_node_t<physical_vessel> n,
+        std::vector<flow_deltas<physical_vessel>::delta>& deltas,
+        std::vector<binary_node_t<physical_vessel>>& nodes) const {
+      return defer_flows_ ? flow_deltas_.flow(n, deltas, nodes) : n.value().flow();
+    }
+    cubic_meters_per_second current_flow(binary_node_t<physical_vessel> n) {
+      return defer_flows_ ? flow_deltas_.fold(n) : n.value().flow();
+    }
+
+    //planned holds a split point computed earlier for the vessel carrying a
+    // given flow; it's used if that flow is still current.
+    vessel_id split_existing_vessel(binary_node_t<physical_vessel> node, macrocell& cell,
+        boost::optional<std::pair<cubic_meters_per_second, m3>> const& planned = boost::none) {
       auto& v = node.value();
+      auto flow = current_flow(node);
+      auto split_v = v;
+      split_v.flow_ = flow;
 
       grid_.remove_item(v);
-      auto new_start = get_split_point(v, cell.center, cell.flow, gamma_);
+      auto new_start = planned && planned->first == flow ? planned->second
+        : get_split_point(split_v, cell.center, cell.flow, gamma_);
       auto old_start = v.start();
       v.set_start(new_start);
       grid_.add_item(v);
 
       auto new_parent = node.make_left_child_of(physical_vessel{old_start, new_start,
-         1_mm, cell_id::invalid(), v.flow(), v.entry_pressure(),
+         1_mm, cell_id::invalid(), flow, v.entry_pressure(),
          get_vessel_id_(), v.is_const()});
-      record_vessel(new_parent);
+      record_new_vessel(new_parent);
+      if (defer_flows_)
+        flow_deltas_.insert_parent(new_parent, node);
       auto cell_vessel = new_parent.set_right_child(physical_vessel{new_start,
         cell.center, 1_mm, cell.id, cell.flow, cell.pressure, get_vessel_id_()});
       cell.parent_vessel = cell_vessel.value().id();
-      record_vessel(cell_vessel);
+      record_new_vessel(cell_vessel);
+      vessel_updater_.mark_dirty(cell_vessel);
+      vessel_updater_.mark_dirty(node);
       return cell.parent_vessel;
     }
 
   public:
-    physical_vessel_tree(build_tree_tag, boost::filesystem::path const& filename, cube<m3> const& extents, double gamma, Pa cell_pressure, cubic_meters_per_second cell_flow, std::mt19937& gen)
+    physical_vessel_tree(build_tree_tag, boost::filesystem::path const& filename, cube<m3> const& extents, double gamma, Pa cell_pressure, cubic_meters_per_second cell_flow, philox4x32& gen)
       : vessels_{}, to_vessels_{}, get_vessel_id_{},
         grid_{extents, 16}, vessel_updater_{vessels_, gamma, cell_pressure, cell_flow, gen}, gamma_{gamma} {
       auto vessel_generator = build_vessel_map(filename);
@@ -96,27 +170,30 @@ namespace jhmi {
       vessel_updater_.normalize_all();
     }
 
-    physical_vessel_tree(load_tree_tag, boost::filesystem::path const& filename, std::mt19937& gen)
+    physical_vessel_tree(load_tree_tag, boost::filesystem::path const& filename, philox4x32& gen)
       : vessels_{}, to_vessels_{}, get_vessel_id_{}, grid_{cube<m3>{}},
         vessel_updater_{vessels_, 2.7, Pa{}, cubic_meters_per_second{}, gen}, gamma_{} {
-      auto vt = load_protobuf<jhmi_message::VesselTree>(filename);
-      gamma_ = vt.gamma();
+      if (is_columnar_tree(filename)) {
+        auto ct = columnar_tree{filename};
+        gamma_ = ct.gamma();
+        load_columnar_vessels(ct, vessels_, [](auto) {});
+      }
+      else {
+        gamma_ = stream_vessels(filename, vessels_).gamma;
+      }
       if (std::abs(gamma_) < 1e-2)
         gamma_ = 2.7;
-      auto vns = load_vessel_protobuf(vt);
       vessel_id max_id{0};
       boost::optional<cube<m3>> ext;
-      RANGES_FOR(auto&& v, vns) {
-        max_id = std::max(max_id, v.second.v.id());
-        ext = ext ? expand(*ext, v.second.v.start())
-                  : cube<m3>{v.second.v.start(), v.second.v.start()};
-        ext = expand(*ext, v.second.v.end());
+      RANGES_FOR(auto&& v, vessels_ | view::pre_order) {
+        max_id = std::max(max_id, v.id());
+        ext = ext ? expand(*ext, v.start()) : cube<m3>{v.start(), v.start()};
+        ext = expand(*ext, v.end());
       }
       grid_ = octtree<distance_vessel>{*ext};
-
-      auto parent_id = jhmi_detail::find_parent_vessel(vns);
-      vessels_ = binary_tree<physical_vessel>{vns.at(parent_id).v};
-      add_children_vessels(vessels_.root(), [&](auto n) { record_vessel(n); }, vns);
+      RANGES_FOR(auto n, vessels_ | view::node_pre_order) {
+        record_vessel(n);
+      }
       get_vessel_id_ = id_generator<vessel_tag>{max_id};
       //No need to use vessel_updater_ here, it should have been saved with
       // desried radii, pressures, etc.
@@ -136,6 +213,25 @@ namespace jhmi {
         n.value().strahler_order = so;
       }
       fmt::print("Highest order: {}\n", vessels_.root().value().strahler_order);
+      vessel_updater_.rehash_all();
+    }
+    //As the build left it.  The grid gets the build's extents, and entry
+    // pressures are restored as stored rather than recomputed, so the
+    // build continues exactly as it would have.
+    physical_vessel_tree(resume_build_tag, jhmi_message::BuildCheckpoint const& cp,
+                         cube<m3> const& extents, philox4x32& gen)
+      : vessels_{}, to_vessels_{}, get_vessel_id_{cp.last_vessel_id()}, grid_{extents, 16},
+        vessel_updater_{vessels_, cp.tree().gamma(), cp.tree().cell_pressure() * pascals,
+                        cp.cell_flow() * boost::units::pow<3>(meters) / seconds, gen},
+        gamma_{cp.tree().gamma()} {
+      auto vns = load_vessel_protobuf(cp.tree());
+      auto parent_id = jhmi_detail::find_parent_vessel(vns);
+      vessels_ = binary_tree<physical_vessel>{vns.at(parent_id).v};
+      add_children_vessels(vessels_.root(), [&](auto n) { record_vessel(n); }, vns);
+      RANGES_FOR(auto&& vtv, cp.tree().vessels()) {
+        to_vessels_.at(vessel_id{vtv.id()}).value().entry_pressure_ = vtv.entry_pressure() * pascals;
+      }
+      vessel_updater_.rehash_all();
     }
 
     auto terminal_vessels() const {
@@ -160,27 +256,116 @@ namespace jhmi {
       // population of microspheres, so min_vessel should be const.
       auto n = min_vessel.set_left_child(v);
       cell.parent_vessel = jhmi::id(v);
-      record_vessel(n);
-      for (n = n.parent(); n; n = n.parent())
-        n.value().flow_ -= cell.flow;
+      record_new_vessel(n);
+      vessel_updater_.mark_dirty(n);
+      subtract_flow(n.parent(), cell.flow);
       return cell.parent_vessel;
     }
-    vessel_id connect_cell(macrocell& cell, std::mt19937& gen) {
-      auto min_vessel = get_nearest_vessel(cell.center, gen);
-      assert(min_vessel);
-      split_existing_vessel(min_vessel, cell);
+    //Where connect_cell would attach a cell at center with the given flow,
+    // drawing from gen; see set_connection_cost.  Safe to call concurrently,
+    // but not while the tree changes.
+    struct planned_connection {
+      vessel_id vessel;
+      m3 vessel_start;//Changes if the vessel is split.
+      cubic_meters_per_second vessel_flow;
+      m3 split_point;
+    };
+  private:
+    //read_flow gives a vessel node's current flow.
+    template <typename ReadFlow>
+    planned_connection plan_connection(m3 const& center, cubic_meters_per_second flow,
+        philox4x32& gen, connection_scratch& s, ReadFlow read_flow) const {
+      auto with_current_flow = [&](vessel_id id) {
+        auto node = to_vessels_.at(id);
+        auto v = node.value();
+        v.flow_ = read_flow(node);
+        return v;
+      };
+      if (connection_cost_ == connection_cost::sampled) {
+        auto v = with_current_flow(get_nearest_vessel_id(center, gen, s.sampler, s.layers));
+        return {v.id(), v.start(), v.flow_, get_split_point(v, center, flow, gamma_)};
+      }
 
-      auto n = to_vessels_.at(cell.parent_vessel);
-      for (n = n.parent(); n; n = n.parent())
-        n.value().flow_ -= cell.flow;
+      //Solve every candidate's split point together and keep the cheapest.
+      // Only the three segments meeting at the split are costed; the flow
+      // added to the vessel's ancestors is the same whichever is chosen, up
+      // to where their paths to the root meet.
+      auto items = grid_.find_n_nearest_items(center, 10, forward_distance_squared());
+      assert(!items.empty());
+      s.candidates.clear();
+      s.batch.clear();
+      for (auto const& item : items) {
+        s.candidates.push_back(with_current_flow(item.id));
+        auto const& v = s.candidates.back();
+        s.batch.add(v.start(), v.end(), center, v.flow(), flow);
+      }
+      s.batch.solve(gamma_);
+      auto e = connection_cost_ == connection_cost::volume ? 2. / gamma_ : 2. / 3.;
+      auto q2 = std::abs(flow.value());
+      auto len = [](m3 const& a, m3 const& b) { return distance(a - b).value(); };
+      std::size_t best = 0;
+      double best_cost = 0;
+      m3 best_point;
+      for (std::size_t i = 0; i < s.candidates.size(); ++i) {
+        auto const& v = s.candidates[i];
+        //Const vessels aren't moved, so they're split at their nearest point.
+        auto b = v.is_const() ? get_split_point(v, center, flow, gamma_) : s.batch.point(i);
+        auto q1 = std::abs(v.flow().value());
+        auto cost = len(v.start(), b) * std::pow(q1 + q2, e) + len(b, v.end()) * std::pow(q1, e)
+          + len(b, center) * std::pow(q2, e) - len(v.start(), v.end()) * std::pow(q1, e);
+        if (i == 0 || cost < best_cost) {
+          best = i;
+          best_cost = cost;
+          best_point = b;
+        }
+      }
+      auto const& v = s.candidates[best];
+      return {v.id(), v.start(), v.flow(), best_point};
+    }
 
+  public:
+    planned_connection plan_connection(m3 const& center, cubic_meters_per_second flow,
+                                       philox4x32& gen, connection_scratch& s) const {
+      return plan_connection(center, flow, gen, s,
+        [&](binary_node_t<physical_vessel> n) { return current_flow(n, s.deltas, s.nodes); });
+    }
+    planned_connection plan_connection(m3 const& center, cubic_meters_per_second flow,
+                                       philox4x32& gen) const {
+      connection_scratch s;
+      return plan_connection(center, flow, gen, s);
+    }
+    vessel_id connect_cell(macrocell& cell, philox4x32& gen) {
+      auto plan = plan_connection(cell.center, cell.flow, gen, connection_scratch_,
+        [this](binary_node_t<physical_vessel> n) { return current_flow(n); });
+      return connect_cell(cell, plan);
+    }
+    //Makes a planned connection, unless its vessel has since been split or
+    // removed, in which case nothing changes and an invalid id is returned.
+    vessel_id connect_cell(macrocell& cell, planned_connection const& plan) {
+      auto it = to_vessels_.find(plan.vessel);
+      if (it == to_vessels_.end() || !(it->second.value().start() == plan.vessel_start))
+        return vessel_id::invalid();
+      split_existing_vessel(it->second, cell, std::make_pair(plan.vessel_flow, plan.split_point));
+      subtract_flow(to_vessels_.at(cell.parent_vessel).parent(), cell.flow);
       return cell.parent_vessel;
     }
     auto gamma() const { return gamma_; }
+    auto cell_flow() const { return vessel_updater_.cell_flow(); }
+    vessel_id last_vessel_id() const { return get_vessel_id_.last(); }
     auto size() const { return to_vessels_.size(); }
     auto vessels() const { return vessels_ | view::pre_order; }
     auto vessel_nodes() const { return vessels_ | view::node_pre_order; }
     auto post_order_vessel_nodes() const { return vessels_ | view::node_post_order; }
+    binary_const_node_t<physical_vessel> root() const { return vessels_.root(); }
+    //Merkle hashes of the tree, kept current by normalization, so comparing
+    // them is enough to tell trees apart; diff_vessel_trees uses them to find
+    // what differs.  Between a change and the next normalize_all they're
+    // stale, and a tree hashed as it stands is returned instead.
+    bool hashes_current() const { return vessel_updater_.hashes_current(); }
+    vessel_tree_hashes const& hashes() const { return vessel_updater_.hashes(); }
+    vessel_tree_hashes current_hashes() const {
+      return hashes_current() ? hashes() : vessel_tree_hashes{vessels_};
+    }
 
     physical_vessel const& at(vessel_id id) const {
       return to_vessels_.at(id).value();
@@ -192,14 +377,48 @@ namespace jhmi {
       return binary_const_node_t<physical_vessel>{to_vessels_.at(id)};
     }
 
+    //How connect_cell and plan_connection choose among the nearest vessels.
+    void set_connection_cost(connection_cost cost) { connection_cost_ = cost; }
+    connection_cost current_connection_cost() const { return connection_cost_; }
+
+    //In deferred mode, connect_cell, connect_cell_initial and remove record
+    // their flow changes rather than walking to the root, so each costs
+    // O(1) instead of O(depth).  Flows are read mid-cycle only where a vessel
+    // is split or planned for, and those reads see exactly what eager updates
+    // would give; see flow_deltas for what they cost.
+    // normalize_all recomputes every flow from the leaves, so it simply drops
+    // the pending deltas; call apply_pending_flows to fold them in otherwise.
+    void set_deferred_flows(bool defer) {
+      if (defer_flows_ && !defer)
+        apply_pending_flows();
+      defer_flows_ = defer;
+    }
+    bool deferred_flows() const { return defer_flows_; }
+
+    //Applies all deferred deltas in one post-order pass over the vessels which
+    // have any below them, after which plan_connection's reads cost O(1).
+    void apply_pending_flows() {
+      if (flow_deltas_.empty())
+        return;
+      flow_deltas_.fold(vessels_.root());
+      flow_deltas_.clear();
+    }
+
+    //Only the vessels changed since the last call (and those whose scaling
+    // changed as a result) are recomputed.
     void normalize_all() {
-      vessel_updater_.normalize_all();
+      flow_deltas_.clear();
+      vessel_updater_.normalize_changed();
+    }
+    //Checks each normalize_all against a full recomputation (without NDEBUG).
+    void verify_normalize(bool verify) {
+      vessel_updater_.verify_incremental(verify);
     }
 
     bool remove(vessel_id id) {
       auto node = to_vessels_.at(id);
       assert(node.value().cell().valid());
-      auto flow = node.value().flow();
+      auto flow = current_flow(node);
       bool remove_left = true;
       std::vector<binary_node_t<physical_vessel>> remove_vessels;
       while (node) {
@@ -220,6 +439,18 @@ namespace jhmi {
         to_vessels_.erase(vessel.value().id());
       }
 
+      //Deltas recorded on the vessels being removed still reach the ancestors
+      // of what replaces them.
+      if (defer_flows_) {
+        bool keep_node = node.value().is_const();
+        auto heir = keep_node ? node : remove_left ? node.right_child() : node.left_child();
+        RANGES_FOR(auto const& vessel, remove_vessels) {
+          move_flow_deltas(vessel, heir, keep_node);
+        }
+        if (!keep_node)
+          move_flow_deltas(node, heir, false);
+      }
+
       if (remove_left)
         node.set_left_child(nullptr);
       else
@@ -235,12 +466,14 @@ namespace jhmi {
         node.replace_parent();
         grid_.add_item(node.value());
       }
-      for (; node; node = node.parent())
-        node.value().flow_ -= flow;
+      vessel_updater_.mark_dirty(node);
+      subtract_flow(node, flow);
       return true;
     }
 
-    void store(jhmi_message::VesselTree& vt) const {
+    //vt is a jhmi_message::VesselTree or a chunked_tree_writer.
+    template <typename VesselTree>
+    void store(VesselTree& vt) const {
       vt.set_gamma(gamma_);
       RANGES_FOR(auto&& v, vessels_ | view::node_level_order) {
         auto p = v.parent();
@@ -266,88 +499,147 @@ namespace jhmi {
       }
     }
 
-    bool validate(bool ignore_unconnected_vessels) const {
+    //Checks one vessel against its children.  Quiet unless verbose, so the
+    // checks can run in parallel and be repeated to report what failed.
+    bool validate_vessel(binary_const_node_t<physical_vessel> n, bool verbose) const {
+      auto close = [&](auto lhs, auto rhs, double eps, vessel_id id,
+                       std::string const& name1, std::string const& name2) {
+        if (verbose)
+          return check_close(lhs, rhs, eps, id, name1, name2);
+        double diff = std::abs(2. * (lhs - rhs) / (lhs + rhs));
+        return !(diff > eps);
+      };
       bool no_errors = true;
-      auto check_errors = [&](binary_const_node_t<physical_vessel> cn, physical_vessel const& v) {
+      auto& v = n.value();
+      auto check_errors = [&](binary_const_node_t<physical_vessel> cn) {
         if (cn) {
           auto const& c = cn.value();
           if (distance(c.start() - v.end()) >= 1e-8_mm) {
-            fmt::print("Invalid spatial distance: {} to {}\n", v.id(), c.id());
+            if (verbose)
+              fmt::print("Invalid spatial distance: {} to {}\n", v.id(), c.id());
             no_errors = false;
           }
         }
       };
-      RANGES_FOR(auto n, vessels_ | view::node_in_order) {
-        check_errors(n.left_child(), n.value());
-        check_errors(n.right_child(), n.value());
+      check_errors(n.left_child());
+      check_errors(n.right_child());
+      if (v.cell().valid() && (n.left_child() || n.right_child())) {
+        if (verbose) {
+          fmt::print("Vessel {} connects macrocell {} and has child vessels\n",
+            v.id(), v.cell());
+        }
+        no_errors = false;
       }
-      std::set<vessel_id> all_vessels;
-      RANGES_FOR(auto const& v, vessels_ | view::in_order) {
-        all_vessels.insert(v.id());
+      if (n.left_child()) {
+        no_errors &= close(v.exit_pressure(),
+          n.left_child().value().entry_pressure(), 1e-3,
+          v.id(), "node exit pressure", "left_child entry pressure");
       }
-      auto grid_vessels = grid_.get_all();
-      std::set<vessel_id> map_vessels;
-      RANGES_FOR(auto& v, to_vessels_ | ranges::view::keys) {
-        map_vessels.insert(v);
+      if (n.right_child()) {
+        no_errors &= close(v.exit_pressure(),
+          n.right_child().value().entry_pressure(), 1e-3,
+          v.id(), "node exit pressure", "right_child entry pressure");
       }
-      if (!ranges::equal(all_vessels, grid_vessels)) {
-        fmt::print("Some vessels not found in the grid:\n");
-        std::set_difference(all_vessels.begin(), all_vessels.end(), grid_vessels.begin(), grid_vessels.end(), std::ostream_iterator<vessel_id>{std::cout, " "});
-        no_errors = false;
+
+      if (n.right_child() && n.left_child()) {
+        no_errors &= close(v.radius(),
+          std::pow(std::pow(n.left_child().value().radius().value(), gamma_)
+                 + std::pow(n.right_child().value().radius().value(), gamma_), 1./gamma_) * meters,
+          1e-5, v.id(), "node radius", "children-derived radius");
+        no_errors &= close(v.flow(),
+          n.left_child().value().flow() + n.right_child().value().flow(),
+          1e-5, v.id(), "children flows", "node flow");
       }
-      if (!ranges::includes(map_vessels, all_vessels, std::less<>{})) {
-        fmt::print("Some vessels not found in the map\n");
-        no_errors = false;
+      else if (n.right_child()) {
+        no_errors &= close(n.right_child().value().radius(), v.radius(),
+          1e-5, v.id(), "right child radius", "node radius");
+        no_errors &= close(v.flow(), n.right_child().value().flow(),
+          1e-4, v.id(), "right child flow", "node flow");
+      }
+      else if (n.left_child()) {
+        no_errors &= close(v.radius(), n.left_child().value().radius(),
+          1e-5, v.id(), "node radius", "left child radius");
+        no_errors &= close(v.flow(), n.left_child().value().flow(),
+          1e-4, v.id(), "node flow", "left child flow");
       }
-      no_errors &= check_close(vessels_.root().value().entry_pressure(), input_pressure,
-        1e-3, vessels_.root().value().id(), "root pressure", "model pressure");
 
-      //Now we need to verify that radii and pressures match our expectations.
-      RANGES_FOR(auto n, vessels_ | view::node_level_order) {
-        auto& v = n.value();
-        if (v.cell().valid() && (n.left_child() || n.right_child())) {
-          fmt::print("Vessel {} connects macrocell {} and has child vessels\n",
-            v.id(), v.cell());
-          no_errors = false;
-        }
-        if (n.left_child()) {
-          no_errors &= check_close(v.exit_pressure(),
-            n.left_child().value().entry_pressure(), 1e-3,
-            v.id(), "node exit pressure", "left_child entry pressure");
-        }
-        if (n.right_child()) {
-          no_errors &= check_close(v.exit_pressure(),
-            n.right_child().value().entry_pressure(), 1e-3,
-            v.id(), "node exit pressure", "right_child entry pressure");
-        }
+      no_errors &= close(v.entry_pressure(), v.exit_pressure() + v.delta_pressure(), 1e-3, v.id(),
+        "entry pressure", "exit pressure");
+      return no_errors;
+    }
+
+    //With fraction < 1, each vessel is checked with that probability (drawn
+    // using sample_seed), none twice, and the vessel ids aren't cross-checked
+    // against the grid and map.
+    bool validate(bool ignore_unconnected_vessels, double fraction = 1.,
+                  std::uint32_t sample_seed = 0) const {
+      bool no_errors = true;
+      auto nodes = vessels_ | view::node_level_order | ranges::to_vector;
+      bool full = fraction >= 1.;
+      if (!full) {
+        philox4x32 gen{sample_seed};
+        decltype(nodes) sample;
+        for_each_bernoulli(nodes.size(), fraction, gen, [&](std::size_t i) { sample.push_back(nodes[i]); });
+        nodes = std::move(sample);
+      }
 
-        if (n.right_child() && n.left_child()) {
-          no_errors &= check_close(v.radius(),
-            std::pow(std::pow(n.left_child().value().radius().value(), gamma_)
-                   + std::pow(n.right_child().value().radius().value(), gamma_), 1./gamma_) * meters,
-            1e-5, v.id(), "node radius", "children-derived radius");
-          no_errors &= check_close(v.flow(),
-            n.left_child().value().flow() + n.right_child().value().flow(),
-            1e-5, v.id(), "children flows", "node flow");
+      if (full) {
+        //Compare vessel ids as bitsets; they're dense.
+        std::size_t max_id = 0;
+        std::vector<vessel_id> grid_vessels;
+        grid_.for_each_item([&](distance_vessel const& dv) { grid_vessels.push_back(dv.id); });
+        for (auto n : nodes)
+          max_id = std::max(max_id, std::size_t(n.value().id().value()));
+        for (auto id : grid_vessels)
+          max_id = std::max(max_id, std::size_t(id.value()));
+        RANGES_FOR(auto& id, to_vessels_ | ranges::view::keys) {
+          max_id = std::max(max_id, std::size_t(id.value()));
         }
-        else if (n.right_child()) {
-          no_errors &= check_close(n.right_child().value().radius(), v.radius(),
-            1e-5, v.id(), "right child radius", "node radius");
-          no_errors &= check_close(v.flow(), n.right_child().value().flow(),
-            1e-4, v.id(), "right child flow", "node flow");
+        boost::dynamic_bitset<> all_vessels(max_id + 1), in_grid(max_id + 1), in_map(max_id + 1);
+        for (auto n : nodes)
+          all_vessels.set(n.value().id().value());
+        for (auto id : grid_vessels)
+          in_grid.set(id.value());
+        RANGES_FOR(auto& id, to_vessels_ | ranges::view::keys) {
+          in_map.set(id.value());
         }
-        else if (n.left_child()) {
-          no_errors &= check_close(v.radius(), n.left_child().value().radius(),
-            1e-5, v.id(), "node radius", "left child radius");
-          no_errors &= check_close(v.flow(), n.left_child().value().flow(),
-            1e-4, v.id(), "node flow", "left child flow");
+        if (all_vessels != in_grid) {
+          fmt::print("Some vessels not found in the grid:\n");
+          auto missing = all_vessels - in_grid;
+          for (auto i = missing.find_first(); i != missing.npos; i = missing.find_next(i))
+            fmt::print("{} ", i);
+          no_errors = false;
+        }
+        if (!all_vessels.is_subset_of(in_map)) {
+          fmt::print("Some vessels not found in the map\n");
+          no_errors = false;
         }
-
-        no_errors &= v.validate();
       }
+      no_errors &= check_close(vessels_.root().value().entry_pressure(), input_pressure,
+        1e-3, vessels_.root().value().id(), "root pressure", "model pressure");
+
+      //Now we need to verify that radii and pressures match our expectations.
+      // Failures are found in parallel, then reported in order.
+      using failures = std::vector<std::size_t>;
+      auto failed = tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, nodes.size(), 1024), failures{},
+        [&](tbb::blocked_range<std::size_t> const& r, failures f) {
+          for (auto i = r.begin(); i != r.end(); ++i) {
+            if (!validate_vessel(nodes[i], false))
+              f.push_back(i);
+          }
+          return f;
+        },
+        [](failures l, failures const& r) {
+          l.insert(l.end(), r.begin(), r.end());
+          return l;
+        });
+      ranges::sort(failed);
+      for (auto i : failed)
+        validate_vessel(nodes[i], true);
+      no_errors &= failed.empty();
 
       if (!ignore_unconnected_vessels) {
-        auto unconnected_vessels = vessels_ | view::node_in_order
+        auto unconnected_vessels = nodes
           | ranges::view::filter([](binary_const_node_t<physical_vessel> n) {
              return !n.left_child() && !n.right_child() && !n.value().cell().valid(); })
           | ranges::to_vector;
@@ -363,8 +655,20 @@ namespace jhmi {
       return no_errors;
     }
   };
+  //Trees with the same shape and nearly equal vessels are equal.  Hashes are
+  // only brought up to date by normalization, so when both trees' are
+  // current, equal trees compare in O(1), and otherwise only the subtrees
+  // whose hashes differ are compared.  Between a change and the next
+  // normalize_all, though, both trees are hashed afresh first, which is two
+  // full O(n) passes.
   bool operator==(physical_vessel_tree const& lhs, physical_vessel_tree const& rhs) {
-    return ranges::equal(lhs.vessels(), rhs.vessels(), std::equal_to<physical_vessel>{});
+    auto compare = [&](vessel_tree_hashes const& lhs_hashes, vessel_tree_hashes const& rhs_hashes) {
+      return lhs_hashes.root() == rhs_hashes.root()
+        || diff_vessel_trees(lhs.root(), lhs_hashes, rhs.root(), rhs_hashes, [](auto, auto) {}) == 0;
+    };
+    if (lhs.hashes_current() && rhs.hashes_current())
+      return compare(lhs.hashes(), rhs.hashes());
+    return compare(lhs.current_hashes(), rhs.current_hashes());
   }
 }
 #endif
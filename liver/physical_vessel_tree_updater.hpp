@@ -2,7 +2,14 @@
 #define JHMI_LIVER_PHYSICAL_VESSEL_TREE_UPDATER_HPP_NRC_20170228
 
 #include "liver/physical_vessel.hpp"
+#include "liver/tree_hash.hpp"
 #include "utility/binary_tree.hpp"
+#include "utility/philox.hpp"
+#include <tbb/tbb.h>
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
 
 namespace jhmi {
   class physical_vessel_tree_updater {
@@ -13,39 +20,82 @@ namespace jhmi {
     std::vector<double> scalars_;
     Pa cell_pressure_;
     cubic_meters_per_second cell_flow_;
-    std::mt19937& gen_;
+    philox4x32& gen_;
+    //Each vessel's radius and entry pressure from the last upward pass, before
+    // normalize_pressure scaled them, and the scalar it then applied.  These
+    // stay valid while nothing below the vessel changes, so only vessels marked
+    // dirty (and their ancestors) need to be recomputed.
+    std::vector<m> unscaled_radius_;
+    std::vector<Pa> unscaled_entry_;
+    std::vector<double> applied_scalar_;
+    std::vector<char> dirty_;
+    std::vector<int> dirty_ids_;
+    std::vector<char> skip_;//Set on vessels normalize_pressure left unchanged.
+    //The vessels (or just the dirty ones) grouped by depth for the upward
+    // pass, then those the downward pass rescaled.  Each vessel's updates
+    // read only its children (going up) or its parent (going down), so a
+    // level can be processed in parallel with the same arithmetic, and
+    // results, as a sequential traversal.
+    std::vector<std::vector<node_t>> levels_;
+    //Current as of the last normalization; only the vessels it rescaled,
+    // which include every changed vessel and its ancestors, are rehashed.
+    vessel_tree_hashes hashes_;
+    bool hashed_ = false;
+    bool cached_ = false;
+    bool verify_ = false;
+
+    void reserve_id(std::size_t idx) {
+      if (scalars_.size() <= idx)
+        scalars_.resize(idx + 1, 1.);
+      if (dirty_.size() <= idx) {
+        auto n = std::max(idx + 1, 2 * dirty_.size());
+        unscaled_radius_.resize(n);
+        unscaled_entry_.resize(n);
+        applied_scalar_.resize(n, 0.);
+        dirty_.resize(n, 0);
+        skip_.resize(n, 0);
+        hashes_.reserve(n - 1);
+      }
+    }
+    bool is_dirty(node_t n) const {
+      auto idx = std::size_t(n.value().id().value());
+      return idx < dirty_.size() && dirty_[idx];
+    }
+    m unscaled_radius(node_t n) const { return unscaled_radius_[n.value().id().value()]; }
+    Pa unscaled_entry(node_t n) const { return unscaled_entry_[n.value().id().value()]; }
 
     void update_pressures(physical_vessel& v, node_t ln, node_t rn) {
       auto& l = ln.value();
       auto& r = rn.value();
-      auto rscalar = get_scalar(rn, l.entry_pressure_);
+      auto rscalar = get_scalar(unscaled_entry(rn), unscaled_entry(ln));
 
-      v.radius_ = std::pow(std::pow(l.radius_.value(), gamma_) + std::pow(r.radius_.value() * rscalar, gamma_), 1/gamma_) * meters;
+      v.radius_ = std::pow(std::pow(unscaled_radius(ln).value(), gamma_) + std::pow(unscaled_radius(rn).value() * rscalar, gamma_), 1/gamma_) * meters;
       v.flow_ = l.flow_ + r.flow_;
-      v.exit_pressure_ = l.entry_pressure_;
+      v.exit_pressure_ = unscaled_entry(ln);
       v.entry_pressure_ = v.exit_pressure_ + v.delta_pressure();
 
+      scalars_[l.id().value()] = 1.;
       scalars_[r.id().value()] = rscalar;
     }
 
     void update_vessel(node_t n) {
       auto& v = n.value();
       auto idx = v.id().value();
-      if (scalars_.size() <= idx)
-        scalars_.resize(idx + 1, 1.);
+      reserve_id(idx);
       auto ln = n.left_child(), rn = n.right_child();
       if (ln && rn) {
-        if (ln.value().entry_pressure() > rn.value().entry_pressure())
+        if (unscaled_entry(ln) > unscaled_entry(rn))
           update_pressures(v, ln, rn);
         else
           update_pressures(v, rn, ln);
       }
       else if (ln || rn) {
-        auto& c = ln ? ln.value() : rn.value();
-        v.radius_ = c.radius_;
-        v.flow_ = c.flow_;
-        v.exit_pressure_ = c.entry_pressure_;
+        auto cn = ln ? ln : rn;
+        v.radius_ = unscaled_radius(cn);
+        v.flow_ = cn.value().flow_;
+        v.exit_pressure_ = unscaled_entry(cn);
         v.entry_pressure_ = v.exit_pressure_ + v.delta_pressure();
+        scalars_[cn.value().id().value()] = 1.;
       }
       else {
         //We're at a terminal vessel.  Sample radius.
@@ -56,6 +106,8 @@ namespace jhmi {
         v.exit_pressure_ = cell_pressure_;
         v.entry_pressure_ = v.exit_pressure_ + v.delta_pressure();
       }
+      unscaled_radius_[idx] = v.radius_;
+      unscaled_entry_[idx] = v.entry_pressure_;
     }
 
     void update_vessel_recursive(node_t n) {
@@ -64,40 +116,190 @@ namespace jhmi {
       update_vessel(n);
       update_vessel_recursive(n.parent());
     }
-    double get_scalar(node_t n, Pa desired_pressure) {
+    double get_scalar(Pa entry_pressure, Pa desired_pressure) {
       return boost::units::pow<boost::units::static_rational<1,4>>(
-          (n.value().entry_pressure_ - cell_pressure_)  / (desired_pressure - cell_pressure_));
-    }
-    void normalize_pressure(node_t start_node, Pa start_pressure) {
-      auto items = std::deque<std::tuple<node_t, Pa, double>>{
-        std::make_tuple(start_node, start_pressure, get_scalar(start_node, start_pressure))};
-      while (!items.empty()) {
-        auto [n, entry_pressure, prev_scalar] = items.front();
-        items.pop_front();
-        auto& v = n.value();
-        auto idx = v.id().value();
-        auto curr_scalar = prev_scalar * scalars_[idx];
-        v.radius_ *= curr_scalar;
-        v.entry_pressure_ = entry_pressure;
-        v.exit_pressure_ = v.entry_pressure_ - v.delta_pressure();
-        if (n.left_child())
-          items.push_back(std::make_tuple(n.left_child(), v.exit_pressure_, curr_scalar));
-        if (n.right_child())
-          items.push_back(std::make_tuple(n.right_child(), v.exit_pressure_, curr_scalar));
+          (entry_pressure - cell_pressure_)  / (desired_pressure - cell_pressure_));
+    }
+    template <typename F>
+    static void for_each_vessel(std::vector<node_t> const& level, F f) {
+      const std::size_t grain = 512;
+      if (level.size() < grain) {
+        for (auto n : level)
+          f(n);
+        return;
+      }
+      tbb::parallel_for(tbb::blocked_range<std::size_t>(0, level.size(), grain),
+        [&](tbb::blocked_range<std::size_t> const& r) {
+          for (auto i = r.begin(); i != r.end(); ++i)
+            f(level[i]);
+        });
+    }
+    //Fills levels_ and makes room for every id, returning the number of
+    // levels.  With dirty_only, only dirty vessels are gathered; since their
+    // ancestors are dirty too, they're reached without entering clean subtrees.
+    std::size_t build_levels(bool dirty_only) {
+      std::size_t num_levels = 0, max_id = 0;
+      auto add = [&](std::size_t depth, node_t n) {
+        if (levels_.size() <= depth)
+          levels_.emplace_back();
+        if (num_levels <= depth) {
+          levels_[depth].clear();
+          num_levels = depth + 1;
+        }
+        levels_[depth].push_back(n);
+        max_id = std::max(max_id, std::size_t(n.value().id().value()));
+      };
+      add(0, tree_.root());
+      for (std::size_t d = 0; d < num_levels; ++d) {
+        for (std::size_t i = 0; i < levels_[d].size(); ++i) {
+          auto n = levels_[d][i];
+          for (auto c : {n.left_child(), n.right_child()}) {
+            if (c && (!dirty_only || is_dirty(c)))
+              add(d + 1, c);
+          }
+        }
+      }
+      reserve_id(max_id);
+      return num_levels;
+    }
+    void update_levels(std::size_t num_levels) {
+      for (auto d = num_levels; d-- > 0;)
+        for_each_vessel(levels_[d], [&](node_t n) { update_vessel(n); });
+    }
+    //Scales the vessels a level at a time from the root down, leaving those
+    // it rescaled in levels_ and returning the number of levels.  When
+    // pruning, a clean vessel whose scalar and entry pressure are what they
+    // were last time is left alone, and the next level holds only the
+    // children of the vessels that weren't, so unchanged subtrees are never
+    // entered.  That only happens when the root's scalar is unchanged too,
+    // though, and adding or removing any cell changes the root's unscaled
+    // entry pressure and so its scalar.  After a growth cycle every vessel is
+    // rescaled, so this pass (and the rehash after it) is O(n) regardless.
+    std::size_t normalize_pressure(bool prune) {
+      auto root_scalar = get_scalar(unscaled_entry(tree_.root()), input_pressure);
+      if (levels_.empty())
+        levels_.emplace_back();
+      levels_[0].assign(1, tree_.root());
+      std::size_t d = 0;
+      for (; !levels_[d].empty(); ++d) {
+        for_each_vessel(levels_[d], [&](node_t n) {
+          auto& v = n.value();
+          auto idx = v.id().value();
+          auto p = n.parent();
+          auto entry_pressure = p ? p.value().exit_pressure_ : input_pressure;
+          auto prev_scalar = p ? applied_scalar_[p.value().id().value()] : root_scalar;
+          auto curr_scalar = prev_scalar * scalars_[idx];
+          skip_[idx] = prune && !dirty_[idx] && applied_scalar_[idx] == curr_scalar
+            && v.entry_pressure_ == entry_pressure;
+          if (skip_[idx])
+            return;
+          applied_scalar_[idx] = curr_scalar;
+          v.radius_ = unscaled_radius_[idx] * curr_scalar;
+          v.entry_pressure_ = entry_pressure;
+          v.exit_pressure_ = v.entry_pressure_ - v.delta_pressure();
+        });
+        if (levels_.size() <= d + 1)
+          levels_.emplace_back();
+        auto& level = levels_[d];
+        level.erase(std::remove_if(level.begin(), level.end(), [&](node_t n) {
+          return skip_[n.value().id().value()] != 0;
+        }), level.end());
+        auto& next = levels_[d + 1];
+        next.clear();
+        for (auto n : level) {
+          if (n.left_child())
+            next.push_back(n.left_child());
+          if (n.right_child())
+            next.push_back(n.right_child());
+        }
+      }
+      return d;
+    }
+    //Rehashes the vessels in levels_, deepest first.
+    void rehash_levels(std::size_t num_levels) {
+      for (auto d = num_levels; d-- > 0;)
+        for_each_vessel(levels_[d], [&](node_t n) { hashes_.update(n); });
+    }
+    void clear_dirty() {
+      for (auto idx : dirty_ids_)
+        dirty_[idx] = 0;
+      dirty_ids_.clear();
+    }
+    void verify_against_full() {
+      auto values = [&] {
+        return tree_ | view::pre_order | ranges::view::transform([](physical_vessel const& v) {
+          return std::make_tuple(v.id(), v.radius_, v.flow_, v.entry_pressure_, v.exit_pressure_);
+        }) | ranges::to_vector;
+      };
+      auto incremental = values();
+      normalize_all();
+      auto full = values();
+      if (incremental.size() != full.size())
+        throw std::runtime_error("Incremental normalization changed the number of vessels");
+      for (std::size_t i = 0; i < full.size(); ++i) {
+        if (incremental[i] != full[i]) {
+          throw std::runtime_error(fmt::format(
+            "Incremental normalization differs from a full one at vessel {}", std::get<0>(full[i])));
+        }
       }
-      ranges::fill(scalars_, 1.);
     }
 
   public:
-    explicit physical_vessel_tree_updater(tree_t& tree, double gamma, Pa cell_pressure, cubic_meters_per_second cell_flow, std::mt19937& gen)
+    explicit physical_vessel_tree_updater(tree_t& tree, double gamma, Pa cell_pressure, cubic_meters_per_second cell_flow, philox4x32& gen)
       : tree_{tree}, gamma_{gamma}, cell_pressure_{cell_pressure}, cell_flow_{cell_flow}, gen_{gen}
     {}
 
+    //Records that n's geometry, flow or children changed since the last
+    // normalization.  Its ancestors are marked as well.
+    void mark_dirty(node_t n) {
+      for (; n && !is_dirty(n); n = n.parent()) {
+        auto idx = n.value().id().value();
+        reserve_id(idx);
+        dirty_[idx] = 1;
+        dirty_ids_.push_back(idx);
+      }
+    }
+    cubic_meters_per_second cell_flow() const { return cell_flow_; }
+    //Hashes every vessel as it stands, for trees loaded rather than built.
+    void rehash_all() {
+      rehash_levels(build_levels(false));
+      hashed_ = true;
+    }
+    //Whether hashes reflect the tree: it's been hashed or normalized, and
+    // nothing has changed since.
+    bool hashes_current() const { return hashed_ && dirty_ids_.empty(); }
+    vessel_tree_hashes const& hashes() const { return hashes_; }
+    //In builds without NDEBUG, compares each normalize_changed against a
+    // full recomputation, throwing if they differ.
+    void verify_incremental(bool verify) { verify_ = verify; }
+
     void normalize_all() {
-      RANGES_FOR(auto& n, tree_.root() | view::node_post_order) {
-        update_vessel(n);
+      ranges::fill(scalars_, 1.);
+      update_levels(build_levels(false));
+      rehash_levels(normalize_pressure(false));
+      hashed_ = true;
+      clear_dirty();
+      cached_ = true;
+    }
+
+    //Same result as normalize_all, but the upward pass only recomputes what
+    // changed below vessels passed to mark_dirty.  The downward pass still
+    // visits every vessel once anything has changed; see normalize_pressure.
+    void normalize_changed() {
+      if (!cached_) {
+        normalize_all();
+        return;
       }
-      normalize_pressure(tree_.root(), input_pressure);
+      if (!is_dirty(tree_.root()))
+        return;
+      //Clean children supply their cached values to dirty parents.
+      update_levels(build_levels(true));
+      rehash_levels(normalize_pressure(true));
+      clear_dirty();
+#ifndef NDEBUG
+      if (verify_)
+        verify_against_full();
+#endif
     }
   };
 }//jhmi
@@ -0,0 +1,57 @@
+#include "liver/bifurcation_batch.hpp"
+#include "liver/get_split_point.hpp"
+#include <random>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+namespace {
+  double angle(m3 const& v1, m3 const& v2) {
+    return acos(dot(v1, v2) / (distance(v1) * distance(v2))).value();
+  }
+}
+
+TEST_CASE( "Batched bifurcation points match find_bifurcation_point", "[bifurcation_batch]" ) {
+  std::mt19937 gen(12);
+  std::uniform_real_distribution<> coord(0, 10), flow(.01, 1);
+  auto pt = [&] { return dbl3{coord(gen), coord(gen), coord(gen)} * mm; };
+  const int n = 10000;
+  const double gamma = 2.7;
+  std::vector<std::tuple<m3,m3,m3,cubic_meters_per_second,cubic_meters_per_second>> problems;
+  bifurcation_batch batch;
+  for (int i = 0; i < n; ++i) {
+    auto p0 = pt(), p1 = pt(), p2 = pt();
+    auto q1 = cubic_meters_per_second::from_value(flow(gen)),
+         q2 = cubic_meters_per_second::from_value(flow(gen));
+    problems.emplace_back(p0, p1, p2, q1, q2);
+    batch.add(p0, p1, p2, q1, q2);
+  }
+  batch.solve(gamma);
+
+  int solved = 0, agree = 0;
+  for (int i = 0; i < n; ++i) {
+    auto [p0, p1, p2, q1, q2] = problems[i];
+    auto pb = batch.point(i);
+    auto expected = find_bifurcation_point(p0, p1, p2, q1, q2, gamma);
+    if (distance(pb - expected) < 1_um)
+      ++agree;
+    if (distance(pb - (p0 + p1 + p2) / 3.) < 1e-9_mm)
+      continue;
+    ++solved;
+    //Wherever it found a point, the branches leave at Murray's angles.
+    if (q1 < q2) {
+      std::swap(p1, p2);
+      std::swap(q1, q2);
+    }
+    auto r = q1 / (q1 + q2);
+    auto togmo = 2. / gamma - 1.;
+    auto th1 = std::acos(.5*(std::pow(r, togmo)+std::pow(r, -togmo)-std::pow(r, togmo)*std::pow(1-r, -2.*togmo)));
+    REQUIRE(std::abs(angle(p1 - pb, pb - p0) - th1) < 1e-8);
+  }
+  REQUIRE(solved > n / 2);
+  //The single-precision solver may land on the other side of its own
+  // tolerance checks now and then.
+  REQUIRE(agree > .98 * n);
+}
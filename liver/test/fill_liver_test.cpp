@@ -1,6 +1,8 @@
 
 #include "liver/fill_liver_volume.hpp"
+#include "liver/tract_lattice.hpp"
 #include "shape/box.hpp"
+#include "shape/voxelized_shape.hpp"
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 #include <fmt/ostream.h>
@@ -35,6 +37,61 @@ TEST_CASE( "Portal tracts two ways", "[fill_liver_volume]" ) {
 }
 #endif
 
+namespace {
+  //Hides the voxelized_shape type so the generic bounding-box enumeration is used.
+  struct generic_shape {
+    voxelized_shape const& shape;
+    bool operator()(m3 const& pt) const { return shape(pt); }
+    friend cube<m3> extents(generic_shape const& s) { return extents(s.shape); }
+  };
+}
+
+TEST_CASE( "Voxelized lobules match generic enumeration", "[fill_liver_volume]" ) {
+  //A hollow ball, so columns contain several runs.
+  auto img = volume_image<std::uint8_t>{int3{40,37,23}, cube<m3>{dbl3{-1,2,3}*mm, dbl3{17,19,15}*mm}};
+  auto center = dbl3{8,10.5,9}*mm;
+  RANGES_FOR(auto pix, img | view::by_location) {
+    auto r = distance(pix.physical_loc - center);
+    pix.value = r < 6_mm && r > 3_mm;
+  }
+  auto shape = voxelized_shape{std::move(img)};
+
+  using lattice_pts = std::vector<std::pair<m3,int3>>;
+  auto fast = lattice_pts{}, slow = lattice_pts{};
+  for_lobule(shape, [&](m3 const& pt, int3 const& ipt) { fast.emplace_back(pt, ipt); });
+  for_lobule(generic_shape{shape}, [&](m3 const& pt, int3 const& ipt) { slow.emplace_back(pt, ipt); });
+  REQUIRE(!fast.empty());
+  REQUIRE(fast == slow);
+
+  fast.clear();
+  slow.clear();
+  for_portal_tract(shape, [&](m3 const& pt, int3 const& ipt) { fast.emplace_back(pt, ipt); });
+  for_portal_tract(generic_shape{shape}, [&](m3 const& pt, int3 const& ipt) { slow.emplace_back(pt, ipt); });
+  REQUIRE(fast == slow);
+  REQUIRE(tracts_in(shape).size() == slow.size());
+}
+
+TEST_CASE( "Cached tract lattice", "[fill_liver_volume]" ) {
+  auto img = volume_image<std::uint8_t>{int3{30,30,12}, cube<m3>{m3{}, dbl3{15,15,6}*mm}};
+  std::fill(img.begin(), img.end(), 1);
+  img(3,4,5) = img(10,10,2) = 0;
+  auto dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  img.write(dir / "mask.datz");
+  auto shape = voxelized_shape{dir / "mask.datz"};
+
+  auto expected = std::vector<std::pair<m3,int3>>{};
+  for_portal_tract(shape, [&](m3 const& pt, int3 const& ipt) { expected.emplace_back(pt, ipt); });
+  for (int pass = 0; pass < 2; ++pass) {
+    auto tracts = tract_lattice{shape};
+    REQUIRE(boost::filesystem::exists(tract_lattice::cache_path(shape)));
+    auto actual = std::vector<std::pair<m3,int3>>{};
+    tracts.for_each([&](m3 const& pt, int3 const& ipt) { actual.emplace_back(pt, ipt); });
+    REQUIRE(actual == expected);
+  }
+  boost::filesystem::remove_all(dir);
+}
+
 TEST_CASE( "Lobule near", "[fill_liver_volume]") {
   auto shape = box{m3{}, dbl3{1,1,1} * 18_mm};
   auto lobules = std::map<int3,m3>{};
@@ -0,0 +1,151 @@
+#include "liver/flow_deltas.hpp"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+namespace {
+  struct test_id {
+    std::size_t id;
+    std::size_t value() const { return id; }
+  };
+  struct test_vessel {
+    double flow_;
+    test_id id_;
+    test_id id() const { return id_; }
+  };
+  using node_t = binary_node_t<test_vessel>;
+
+  //The same tree twice, one updated eagerly and the other through
+  // flow_deltas, changed as physical_vessel_tree changes its vessels.  The
+  // root never changes, as the const vessels don't.
+  struct mirrored_trees {
+    binary_tree<test_vessel> eager{test_vessel{0., test_id{0}}};
+    binary_tree<test_vessel> deferred{test_vessel{0., test_id{0}}};
+    std::vector<node_t> eager_nodes{eager.root()};
+    std::vector<node_t> deferred_nodes{deferred.root()};
+    std::vector<std::size_t> alive;
+    flow_deltas<test_vessel> deltas;
+    std::vector<flow_deltas<test_vessel>::delta> delta_scratch;
+    std::vector<node_t> node_scratch;
+
+    static void subtract_eagerly(node_t n, double flow) {
+      for (; n; n = n.parent())
+        n.value().flow_ -= flow;
+    }
+    std::size_t next_id() const { return eager_nodes.size(); }
+    void add(node_t e, node_t d) {
+      alive.push_back(e.value().id().value());
+      eager_nodes.push_back(e);
+      deferred_nodes.push_back(d);
+    }
+    double read(std::size_t i) {
+      return deltas.flow(deferred_nodes[i], delta_scratch, node_scratch);
+    }
+
+    //As connect_cell_initial.
+    void connect_initial(double flow) {
+      auto e = eager.root().set_left_child(test_vessel{flow, test_id{next_id()}});
+      auto d = deferred.root().set_left_child(test_vessel{flow, test_id{next_id()}});
+      deltas.record_new(d);
+      add(e, d);
+      subtract_eagerly(e.parent(), flow);
+      deltas.subtract(d.parent(), flow);
+    }
+    //As split_existing_vessel followed by subtract_flow.
+    void split(std::size_t i, double flow) {
+      auto e = eager_nodes[i], d = deferred_nodes[i];
+      auto current = deltas.fold(d);
+      REQUIRE(current == e.value().flow_);
+      auto parent_id = test_id{next_id()}, cell_id = test_id{next_id() + 1};
+      auto e_parent = e.make_left_child_of(test_vessel{current, parent_id});
+      auto d_parent = d.make_left_child_of(test_vessel{current, parent_id});
+      deltas.record_new(d_parent);
+      deltas.insert_parent(d_parent, d);
+      add(e_parent, d_parent);
+      auto e_cell = e_parent.set_right_child(test_vessel{flow, cell_id});
+      auto d_cell = d_parent.set_right_child(test_vessel{flow, cell_id});
+      deltas.record_new(d_cell);
+      add(e_cell, d_cell);
+      subtract_eagerly(e_parent, flow);
+      deltas.subtract(d_parent, flow);
+    }
+    //As remove, for the leaf i.
+    void remove(std::size_t i) {
+      auto e = eager_nodes[i], d = deferred_nodes[i];
+      auto flow = deltas.fold(d);
+      REQUIRE(flow == e.value().flow_);
+      auto e_node = e.parent(), d_node = d.parent();
+      bool keep_node = e_node == eager.root();
+      bool remove_left = e.is_left_child();
+      auto sibling = [&](node_t n) { return remove_left ? n.right_child() : n.left_child(); };
+      auto e_heir = keep_node ? e_node : sibling(e_node);
+      auto d_heir = keep_node ? d_node : sibling(d_node);
+      deltas.move(d, d_heir, keep_node);
+      if (!keep_node)
+        deltas.move(d_node, d_heir, false);
+      auto forget = [&](node_t n) {
+        alive.erase(std::find(alive.begin(), alive.end(), n.value().id().value()));
+      };
+      forget(e);
+      for (auto n : {e_node, d_node}) {
+        if (remove_left)
+          n.set_left_child(nullptr);
+        else
+          n.set_right_child(nullptr);
+      }
+      if (!keep_node) {
+        forget(e_node);
+        e_heir.replace_parent();
+        d_heir.replace_parent();
+      }
+      subtract_eagerly(e_heir, flow);
+      deltas.subtract(d_heir, flow);
+    }
+  };
+}
+
+TEST_CASE( "Deferred flows match eager updates bitwise", "[flow_deltas]" ) {
+  auto gen = std::mt19937_64{20261019};
+  auto flow = std::uniform_real_distribution<double>{-1e-8, -1e-12};
+  auto pick = [&](std::size_t n) { return std::uniform_int_distribution<std::size_t>{0, n - 1}(gen); };
+  mirrored_trees trees;
+  trees.connect_initial(flow(gen));
+  for (int step = 0; step < 20000; ++step) {
+    if (trees.alive.empty()) {
+      trees.connect_initial(flow(gen));
+      continue;
+    }
+    auto i = trees.alive[pick(trees.alive.size())];
+    auto e = trees.eager_nodes[i];
+    auto op = pick(10);
+    if (op < 5) {
+      trees.split(i, flow(gen));
+    }
+    else if (op < 7) {
+      if (!e.left_child() && !e.right_child())
+        trees.remove(i);
+    }
+    else if (op < 9) {
+      REQUIRE(trees.read(i) == e.value().flow_);
+    }
+    else {
+      //Folding leaves nothing below to be visited again.
+      REQUIRE(trees.deltas.fold(trees.deferred_nodes[i]) == e.value().flow_);
+      auto d = trees.deferred_nodes[i];
+      REQUIRE(!(d.left_child() && trees.deltas.below(d.left_child())));
+      REQUIRE(!(d.right_child() && trees.deltas.below(d.right_child())));
+    }
+    if (step % 1000 == 999) {
+      trees.deltas.fold(trees.deferred.root());
+      trees.deltas.clear();
+      REQUIRE(trees.deferred.root().value().flow_ == trees.eager.root().value().flow_);
+      for (auto j : trees.alive)
+        REQUIRE(trees.deferred_nodes[j].value().flow_ == trees.eager_nodes[j].value().flow_);
+    }
+  }
+}
@@ -0,0 +1,138 @@
+#include "liver/locations/free_site_index.hpp"
+#include "liver/locations/lattice_locations.hpp"
+#include "shape/voxelized_shape.hpp"
+#include <map>
+#include <random>
+#include <set>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+TEST_CASE( "Free sites are sampled with balanced layers", "[free_site_index]" ) {
+  auto ext = cube<m3>{m3{}, dbl3{10,10,10}*mm};
+  auto locs = std::vector<std::pair<m3,int3>>{};
+  for (int z = 0; z < 7; ++z)
+    for (int y = 0; y < 20; ++y)
+      for (int x = 0; x < 20; ++x)
+        if ((x*7 + y*3 + z) % 5 != 0)
+          locs.emplace_back(dbl3{x*.5 + .1, y*.5 + .2, z*1.4 + .3}*mm, int3{x,y,z});
+
+  auto sites = free_site_index{cube<int3>{int3{}, int3{20,20,7}}, ext};
+  sites.reset(locs, 1.2_mm);
+  for (int i = 0; i < 300; ++i)
+    sites.occupy(locs[(i*37) % locs.size()].second);
+  for (int i = 0; i < 100; ++i)
+    sites.release(locs[(i*37) % locs.size()].second);
+
+  auto pt = dbl3{5,5,5}*mm;
+  auto radius = 2.1_mm;
+  auto expected = std::map<int3,double>{};
+  auto layers = std::map<long,int>{};
+  auto layer = [](m3 const& p) { return std::lround(p.z / lobule::cell_thickness); };
+  for (auto&& l : locs) {
+    if (!sites.is_occupied(l.second) && distance_squared(l.first, pt) < radius * radius)
+      ++layers[layer(l.first)];
+  }
+  for (auto&& l : locs) {
+    if (!sites.is_occupied(l.second) && distance_squared(l.first, pt) < radius * radius)
+      expected[l.second] = 1. / layers.size() / layers[layer(l.first)];
+  }
+
+  std::mt19937 gen(5);
+  auto counts = std::map<int3,int>{};
+  int n = 1'000'000;
+  for (int i = 0; i < n; ++i) {
+    auto s = sites.sample_near(pt, radius, gen);
+    REQUIRE(bool(s));
+    ++counts[s->second];
+  }
+  REQUIRE(counts.size() == expected.size());
+  for (auto&& e : expected)
+    REQUIRE(std::abs(counts[e.first] / double(n) - e.second) < 2e-3);
+
+  sites.reset(locs, 1.2_mm);
+  REQUIRE(!bool(sites.sample_near(dbl3{50,50,50}*mm, radius, gen)));
+}
+
+namespace {
+  //A hollow ball, so some neighbourhoods have no sites at all.
+  voxelized_shape test_liver() {
+    auto img = volume_image<std::uint8_t>{int3{40,37,23}, cube<m3>{dbl3{-1,2,3}*mm, dbl3{17,19,15}*mm}};
+    auto center = dbl3{8,10.5,9}*mm;
+    RANGES_FOR(auto pix, img | view::by_location) {
+      auto r = distance(pix.physical_loc - center);
+      pix.value = r < 6_mm && r > 3_mm;
+    }
+    return voxelized_shape{std::move(img)};
+  }
+}
+
+TEST_CASE( "Tract index blocks hold every tract near a point", "[lattice_locations]" ) {
+  auto shape = test_liver();
+  auto ul = extents(shape).ul();
+  auto tracts = std::vector<std::pair<m3,int3>>{};
+  for_portal_tract(shape, [&](m3 const& pt, int3 const& ipt) { tracts.emplace_back(pt - ul, ipt); });
+  REQUIRE(!tracts.empty());
+
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> coord(-1, 20), size(.01, 3);
+  for (int i = 0; i < 2000; ++i) {
+    auto c = dbl3{coord(gen), coord(gen), coord(gen)} * mm;
+    auto r = size(gen) * dbl3{1,1,1} * mm;
+    auto box = cube<m3>{c - r, c + r};
+    auto block = jhmi_detail::tract_indices_within(box);
+    for (auto&& t : tracts) {
+      if (t.first.x >= box.ul().x && t.first.x <= box.lr().x && t.first.y >= box.ul().y
+          && t.first.y <= box.lr().y && t.first.z >= box.ul().z && t.first.z <= box.lr().z) {
+        REQUIRE(t.second.x >= block.ul().x);
+        REQUIRE(t.second.x < block.lr().x);
+        REQUIRE(t.second.y >= block.ul().y);
+        REQUIRE(t.second.y < block.lr().y);
+        REQUIRE(t.second.z >= block.ul().z);
+        REQUIRE(t.second.z < block.lr().z);
+      }
+    }
+  }
+}
+
+TEST_CASE( "Locations are found whenever a free site is near", "[lattice_locations]" ) {
+  auto shape = test_liver();
+  auto cell_radius = .25_mm;
+  auto locations = lattice_locations{shape, cell_radius, cubic_meters_per_second{1e-6}};
+  locations.reset(cell_radius, {}, true);
+  auto tracts = std::vector<std::pair<m3,int3>>{};
+  for_portal_tract(shape, [&](m3 const& pt, int3 const& ipt) { tracts.emplace_back(pt, ipt); });
+
+  std::mt19937 gen(8);
+  philox4x32 sample_gen{8};
+  std::uniform_real_distribution<double> coord(-1, 20);
+  for (double occupied : {.5, .9, .99}) {
+    std::bernoulli_distribution occupy(occupied);
+    auto occupancy = std::vector<bool>{};
+    for (auto&& t : tracts) {
+      occupancy.push_back(occupy(gen));
+      auto m = macrocell{t.first, vessel_id{}, cell_type::normal, cell_radius, cell_id{}, {}, {}, t.second};
+      if (occupancy.back())
+        locations.add_item(m);
+      else
+        locations.remove_item(m);
+    }
+    auto rsq = 36. * cell_radius * cell_radius;
+    int found = 0;
+    for (int i = 0; i < 3000; ++i) {
+      auto pt = dbl3{coord(gen), coord(gen), coord(gen)} * mm;
+      bool any_free = false;
+      for (std::size_t j = 0; j < tracts.size() && !any_free; ++j)
+        any_free = !occupancy[j] && distance_squared(tracts[j].first, pt) < rsq;
+      auto loc = locations.find_location(pt, boost::none, sample_gen);
+      REQUIRE(bool(loc) == any_free);
+      if (loc) {
+        REQUIRE(locations.is_free(*loc));
+        ++found;
+      }
+    }
+    REQUIRE(found > 0);
+  }
+}
@@ -0,0 +1,65 @@
+#include "liver/tree_hash.hpp"
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+namespace {
+  //A root with two children, the left of which has a child of its own.
+  binary_tree<physical_vessel> make_tree(m last_radius, bool with_last = true) {
+    auto vessel = [](double x, m radius, int id) {
+      return physical_vessel{dbl3{x, 0, 0} * mm, dbl3{x + 1, 1, 0} * mm, radius,
+        cell_id::invalid(), cubic_meters_per_second::from_value(1e-8), 3000. * pascals, vessel_id{id}};
+    };
+    auto tree = binary_tree<physical_vessel>{vessel(0, 100_um, 0)};
+    auto left = tree.root().set_left_child(vessel(1, 80_um, 1));
+    tree.root().set_right_child(vessel(2, 70_um, 2));
+    if (with_last)
+      left.set_left_child(vessel(3, last_radius, 3));
+    return tree;
+  }
+}
+
+TEST_CASE( "Subtree hashes find the vessels which differ", "[tree_hash]" ) {
+  auto tree = make_tree(50_um);
+  auto same = make_tree(50_um);
+  auto hashes = vessel_tree_hashes{tree};
+  REQUIRE(hashes.root() == vessel_tree_hashes{same}.root());
+
+  auto changed = make_tree(60_um);
+  auto changed_hashes = vessel_tree_hashes{changed};
+  REQUIRE(hashes.root() != changed_hashes.root());
+  //Only the path from the root to the change is affected.
+  REQUIRE(hashes.at(vessel_id{2}) == changed_hashes.at(vessel_id{2}));
+  REQUIRE(hashes.at(vessel_id{1}) != changed_hashes.at(vessel_id{1}));
+  std::vector<vessel_id> reported;
+  auto n = diff_vessel_trees(tree.root(), hashes, changed.root(), changed_hashes,
+    [&](auto l, auto r) { reported.push_back(l.value().id()); REQUIRE(r); });
+  REQUIRE(n == 1);
+  REQUIRE(reported == std::vector<vessel_id>{vessel_id{3}});
+
+  auto pruned = make_tree(50_um, false);
+  auto pruned_hashes = vessel_tree_hashes{pruned};
+  reported.clear();
+  n = diff_vessel_trees(tree.root(), hashes, pruned.root(), pruned_hashes,
+    [&](auto l, auto r) { reported.push_back(l.value().id()); REQUIRE(!r); });
+  REQUIRE(n == 1);
+  REQUIRE(reported == std::vector<vessel_id>{vessel_id{3}});
+}
+
+TEST_CASE( "Updating changed vessels keeps hashes current", "[tree_hash]" ) {
+  auto tree = make_tree(50_um);
+  auto hashes = vessel_tree_hashes{tree};
+  //Change the deepest vessel, then rehash it and its ancestors.
+  auto leaf = tree.root().left_child().left_child();
+  leaf.value() = make_tree(60_um).root().left_child().left_child().value();
+  for (auto n = leaf; n; n = n.parent())
+    hashes.update(n);
+  auto full = vessel_tree_hashes{tree};
+  REQUIRE(hashes.root() == full.root());
+  for (int id = 0; id < 4; ++id)
+    REQUIRE(hashes.at(vessel_id{id}) == full.at(vessel_id{id}));
+  REQUIRE(hashes.root() != vessel_tree_hashes{make_tree(50_um)}.root());
+}
@@ -0,0 +1,110 @@
+#ifndef JHMI_LIVER_TRACT_LATTICE_HPP_NRC_20261019
+#define JHMI_LIVER_TRACT_LATTICE_HPP_NRC_20261019
+
+#include "liver/fill_liver_volume.hpp"
+#include "utility/write_file_atomically.hpp"
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <fmt/format.h>
+#include <cstring>
+
+namespace jhmi {
+
+  //The portal tracts of a voxelized shape, in for_portal_tract order.
+  // Enumerating the lattice over a full liver is slow, so the result is cached
+  // next to the shape's file, keyed by the shape's contents, and memory mapped
+  // on later runs.  Shapes not loaded from a file are simply enumerated.
+  class tract_lattice {
+    struct header {
+      char magic[8];
+      std::uint64_t shape_hash;
+      std::uint64_t count;
+      double lattice[5];//Guards against changes to the lobule constants.
+    };
+    static header expected_header(voxelized_shape const& shape, std::uint64_t count) {
+      using namespace lobule;
+      header h{{'J','H','M','I','T','R','C','1'}, shape.hash(), count,
+               {xstep.value(), ystep.value(), zstep.value(), yoff0.value(), yoff1.value()}};
+      return h;
+    }
+
+    boost::iostreams::mapped_file_source file_;
+    std::vector<m3> built_pts_;
+    std::vector<int3> built_idxs_;
+    m3 const* pts_ = nullptr;
+    int3 const* idxs_ = nullptr;
+    std::size_t size_ = 0;
+
+    bool load(boost::filesystem::path const& path, voxelized_shape const& shape) {
+      boost::system::error_code ec;
+      auto file_size = boost::filesystem::file_size(path, ec);
+      if (ec || file_size < sizeof(header))
+        return false;
+      try {
+        file_.open(path.string());
+      }
+      catch (std::exception const&) {
+        return false;
+      }
+      header h;
+      std::memcpy(&h, file_.data(), sizeof(h));
+      auto expected = expected_header(shape, h.count);
+      if (std::memcmp(&h, &expected, sizeof(h)) != 0
+          || file_size != sizeof(header) + h.count * (sizeof(m3) + sizeof(int3))) {
+        file_.close();
+        return false;
+      }
+      size_ = h.count;
+      pts_ = reinterpret_cast<m3 const*>(file_.data() + sizeof(header));
+      idxs_ = reinterpret_cast<int3 const*>(file_.data() + sizeof(header) + size_ * sizeof(m3));
+      return true;
+    }
+    //Failure to write the cache is not an error; we'll just enumerate again next time.
+    void store(boost::filesystem::path const& path, voxelized_shape const& shape) const {
+      write_file_atomically(path, [&](std::ostream& out) {
+        auto h = expected_header(shape, size_);
+        out.write(reinterpret_cast<char const*>(&h), sizeof(h));
+        out.write(reinterpret_cast<char const*>(pts_), size_ * sizeof(m3));
+        out.write(reinterpret_cast<char const*>(idxs_), size_ * sizeof(int3));
+      });
+    }
+
+  public:
+    static_assert(sizeof(m3) == 3 * sizeof(double), "m3 must be packed to be cached");
+    static_assert(sizeof(int3) == 3 * sizeof(int), "int3 must be packed to be cached");
+
+    static boost::filesystem::path cache_path(voxelized_shape const& shape) {
+      auto const& fn = shape.filename();
+      return fn.parent_path() / fmt::format("{}.{:016x}.tracts", fn.stem().string(), shape.hash());
+    }
+
+    explicit tract_lattice(voxelized_shape const& shape) {
+      auto path = shape.filename().empty() ? boost::filesystem::path{} : cache_path(shape);
+      if (!path.empty() && load(path, shape))
+        return;
+      for_portal_tract(shape, [&](m3 const& pt, int3 const& ipt) {
+        built_pts_.push_back(pt);
+        built_idxs_.push_back(ipt);
+      });
+      pts_ = built_pts_.data();
+      idxs_ = built_idxs_.data();
+      size_ = built_pts_.size();
+      if (!path.empty())
+        store(path, shape);
+    }
+    tract_lattice(tract_lattice const&) = delete;
+    tract_lattice& operator=(tract_lattice const&) = delete;
+
+    std::size_t size() const { return size_; }
+    auto points() const { return ranges::make_iterator_range(pts_, pts_ + size_); }
+    auto indices() const { return ranges::make_iterator_range(idxs_, idxs_ + size_); }
+
+    //Calls f(m3, int3) for each tract, exactly as for_portal_tract would.
+    template <typename F>
+    void for_each(F f) const {
+      for (std::size_t i = 0; i < size_; ++i)
+        f(pts_[i], idxs_[i]);
+    }
+  };
+}
+
+#endif
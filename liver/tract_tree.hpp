@@ -2,12 +2,20 @@
 #define JHMI_LIVER_WALRAND_TRACT_TREE_HPP_NRC_20160206
 
 #include "liver/build_vessel_map.hpp"
+#include "liver/columnar_tree.hpp"
 #include "liver/fill_liver_volume.hpp"
 #include "liver/load_vessel_protobuf.hpp"
+#include "liver/stream_vessel_tree.hpp"
 #include "utility/binary_tree.hpp"
 #include "utility/volume_image.hpp"
+#include "utility/write_file_atomically.hpp"
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <range/v3/view.hpp>
 #include <tbb/tbb.h>
-#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
 
 namespace jhmi {
   struct flow_vessel {
@@ -23,22 +31,133 @@ namespace jhmi {
   };
   auto id(flow_vessel const& f) { return f.id; }
 
-  class tract_tree {
-    binary_tree<flow_vessel> vessels_;
+  class tract_tree;
+
+  //A vessel of a tract_tree, used as a binary_tree's nodes are.  Null when
+  // default constructed, or as the child of a leaf or the parent of the root.
+  class tract_node {
+    tract_tree const* tree_;
+    std::int32_t idx_;
   public:
-    explicit tract_tree(binary_tree<flow_vessel>&& vessels) : vessels_{std::move(vessels)} {}
+    tract_node() : tree_{nullptr}, idx_{-1} {}
+    tract_node(tract_tree const* tree, std::int32_t idx) : tree_{tree}, idx_{idx} {}
+    explicit operator bool() const { return idx_ >= 0; }
+    //Where this vessel falls in the tree's preorder.
+    std::int32_t index() const { return idx_; }
+    flow_vessel const& value() const;
+    tract_node left_child() const;
+    tract_node right_child() const;
+    tract_node parent() const;
+  };
 
-    explicit tract_tree(boost::filesystem::path const& filename) : vessels_{} {
+  //The vessel tree particles are distributed through: the straight vessel of
+  // each bifurcation is on the left, and a vessel standing in for its portal
+  // tract is added under every terminal vessel.  The vessels are held in preorder,
+  // with the indices of each one's children and parent alongside.
+  //
+  //Building this from a tree file is what dominates a distribution's
+  // loading time, so the result is cached next to the file, keyed by its
+  // contents, and memory mapped on later runs.
+  class tract_tree {
+    struct header {
+      char magic[8];
+      std::uint64_t tree_hash;
+      std::uint64_t count;
+      double cell_thickness;//Guards against a change to the tracts' length.
+    };
+    static header expected_header(std::uint64_t tree_hash, std::uint64_t count) {
+      return header{{'J','H','M','I','T','R','T','1'}, tree_hash, count, lobule::cell_thickness.value()};
+    }
+    static constexpr std::size_t bytes_per_vessel = sizeof(flow_vessel) + 4 * sizeof(std::int32_t);
 
-      auto vt = load_protobuf<jhmi_message::VesselTree>(filename);
-      auto vns = load_vessel_protobuf(vt);
-      auto parent_id = jhmi_detail::find_parent_vessel(vns);
-      vessels_ = binary_tree<flow_vessel>{vns.at(parent_id).v};
-      add_children_vessels(vessels_.root(), [&](auto) {}, vns);
+    boost::iostreams::mapped_file_source file_;
+    std::vector<flow_vessel> built_vessels_;
+    std::vector<std::int32_t> built_links_;//Left, right, parent and post_order, in turn.
+    flow_vessel const* vessels_ = nullptr;
+    std::int32_t const* left_ = nullptr;
+    std::int32_t const* right_ = nullptr;
+    std::int32_t const* parent_ = nullptr;
+    std::int32_t const* post_order_ = nullptr;//Preorder indices, in postorder.
+    std::size_t size_ = 0;
+
+    friend class tract_node;
+
+    void set_links(std::int32_t const* links) {
+      left_ = links;
+      right_ = links + size_;
+      parent_ = links + 2 * size_;
+      post_order_ = links + 3 * size_;
+    }
+    void flatten(binary_tree<flow_vessel> const& tree) {
+      auto index = vidx_to<std::int32_t>{};
+      for (auto n : tree | view::node_pre_order) {
+        index.insert(std::make_pair(n.value().id, std::int32_t(built_vessels_.size())));
+        built_vessels_.push_back(n.value());
+      }
+      size_ = built_vessels_.size();
+      built_links_.resize(4 * size_);
+      auto at = [&](binary_const_node_t<flow_vessel> n) {
+        return n ? index.at(n.value().id) : std::int32_t(-1);
+      };
+      for (auto n : tree | view::node_pre_order) {
+        auto i = index.at(n.value().id);
+        built_links_[i] = at(n.left_child());
+        built_links_[size_ + i] = at(n.right_child());
+        built_links_[2 * size_ + i] = at(n.parent());
+      }
+      auto post = built_links_.begin() + 3 * size_;
+      for (auto n : tree | view::node_post_order)
+        *post++ = index.at(n.value().id);
+      vessels_ = built_vessels_.data();
+      set_links(built_links_.data());
+    }
+
+    bool load(boost::filesystem::path const& path, std::uint64_t tree_hash) {
+      boost::system::error_code ec;
+      auto file_size = boost::filesystem::file_size(path, ec);
+      if (ec || file_size < sizeof(header))
+        return false;
+      try {
+        file_.open(path.string());
+      }
+      catch (std::exception const&) {
+        return false;
+      }
+      header h;
+      std::memcpy(&h, file_.data(), sizeof(h));
+      auto expected = expected_header(tree_hash, h.count);
+      if (std::memcmp(&h, &expected, sizeof(h)) != 0
+          || file_size != sizeof(header) + h.count * bytes_per_vessel) {
+        file_.close();
+        return false;
+      }
+      size_ = h.count;
+      vessels_ = reinterpret_cast<flow_vessel const*>(file_.data() + sizeof(header));
+      set_links(reinterpret_cast<std::int32_t const*>(file_.data() + sizeof(header) + size_ * sizeof(flow_vessel)));
+      return true;
+    }
+    //Failure to write the cache is not an error; we'll just build again next time.
+    void store(boost::filesystem::path const& path, std::uint64_t tree_hash) const {
+      write_file_atomically(path, [&](std::ostream& out) {
+        auto h = expected_header(tree_hash, size_);
+        out.write(reinterpret_cast<char const*>(&h), sizeof(h));
+        out.write(reinterpret_cast<char const*>(vessels_), size_ * sizeof(flow_vessel));
+        out.write(reinterpret_cast<char const*>(built_links_.data()), built_links_.size() * sizeof(std::int32_t));
+      });
+    }
+
+    static binary_tree<flow_vessel> build(boost::filesystem::path const& filename) {
+      auto vessels = binary_tree<flow_vessel>{};
+      if (is_columnar_tree(filename)) {
+        load_columnar_vessels(columnar_tree{filename}, vessels, [](auto) {});
+      }
+      else {
+        stream_vessels(filename, vessels);
+      }
       //Finally, swap left and right such that the straight vessel is on the left.
       auto max_id = vessel_id::invalid();
       m min_rad = 100_mm;
-      for (auto n : vessels_ | view::node_post_order) {
+      for (auto n : vessels | view::node_post_order) {
         min_rad = std::min(min_rad, n.value().radius);
         max_id = std::max(max_id, n.value().id);
         if (n.left_child() && n.right_child()) {
@@ -55,7 +174,7 @@ namespace jhmi {
       fmt::print("Min radius: {:1.10f} m\n", min_rad.value());
       auto id_gen = make_generator(max_id);
       int num_tracts = 0, num_zero_length = 0, num_ternary = 0;
-      for (auto n : vessels_ | view::node_post_order) {
+      for (auto n : vessels | view::node_post_order) {
         if (!n.left_child()) {
           n.set_left_child(flow_vessel{id_gen(), n.value().end,
             n.value().end + m3{0_mm,0_mm,lobule::cell_thickness},
@@ -69,18 +188,86 @@ namespace jhmi {
         }
       }
       fmt::print("# zero length: {}, # total {}, #ternary {}\n", 100 * num_zero_length, num_tracts, num_ternary);
+      return vessels;
+    }
+
+  public:
+    static_assert(sizeof(flow_vessel) == 8 * sizeof(double), "flow_vessel must be packed to be cached");
+
+    //FNV-1a over the tree file and, for a delta snapshot, the files it builds on.
+    static std::uint64_t tree_hash(boost::filesystem::path const& filename) {
+      auto hash = 14695981039346656037ull;
+      auto file = filename;
+      std::set<boost::filesystem::path> seen;
+      while (seen.insert(file).second) {
+        {
+          boost::iostreams::mapped_file_source f{file.string()};
+          auto bytes = reinterpret_cast<unsigned char const*>(f.data());
+          for (std::size_t i = 0; i < f.size(); ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        if (!is_delta_snapshot(file))
+          break;
+        auto delta = load_protobuf<jhmi_message::VesselTreeDelta>(file, int(sizeof(jhmi_detail::delta_magic)));
+        file = file.parent_path() / delta.base();
+      }
+      return hash;
+    }
+    static boost::filesystem::path cache_path(boost::filesystem::path const& filename, std::uint64_t tree_hash) {
+      return filename.parent_path() / fmt::format("{}.{:016x}.tracttree", filename.stem().string(), tree_hash);
+    }
+
+    //Uses the tree as given, without moving the straight vessels to the left
+    // or adding tracts.
+    explicit tract_tree(binary_tree<flow_vessel>&& vessels) { flatten(vessels); }
+
+    explicit tract_tree(boost::filesystem::path const& filename) {
+      auto hash = tree_hash(filename);
+      auto path = cache_path(filename, hash);
+      if (load(path, hash))
+        return;
+      flatten(build(filename));
+      store(path, hash);
     }
+    tract_tree(tract_tree const&) = delete;
+    tract_tree& operator=(tract_tree const&) = delete;
+
+    std::size_t size() const { return size_; }
+    tract_node node(std::int32_t idx) const { return tract_node{this, idx}; }
+    flow_vessel const& vessel(std::int32_t idx) const { return vessels_[idx]; }
+    //The preorder indices of a vessel's children and parent, -1 where it has none.
+    std::int32_t left(std::int32_t idx) const { return left_[idx]; }
+    std::int32_t right(std::int32_t idx) const { return right_[idx]; }
+    std::int32_t parent(std::int32_t idx) const { return parent_[idx]; }
+    //The preorder indices of the vessels, in postorder.
+    auto post_order() const { return ranges::make_iterator_range(post_order_, post_order_ + size_); }
+
     auto vessel_nodes_preorder() const {
-      return vessels_ | view::node_pre_order;
+      return ranges::view::ints(std::int32_t(0), std::int32_t(size_))
+        | ranges::view::transform([this](std::int32_t i) { return node(i); });
     }
     auto vessel_nodes_postorder() const {
-      return vessels_ | view::node_post_order;
+      return post_order() | ranges::view::transform([this](std::int32_t i) { return node(i); });
     }
 
     auto vessels_postorder() const {
-      return vessels_ | view::post_order;
+      return post_order() | ranges::view::transform([this](std::int32_t i) -> flow_vessel const& { return vessels_[i]; });
     }
-    auto root_node() const { return vessels_.root(); }
+    tract_node root_node() const { return size_ ? node(0) : tract_node{}; }
   };
+
+  inline flow_vessel const& tract_node::value() const { return tree_->vessels_[idx_]; }
+  inline tract_node tract_node::left_child() const {
+    auto i = tree_->left_[idx_];
+    return i < 0 ? tract_node{} : tract_node{tree_, i};
+  }
+  inline tract_node tract_node::right_child() const {
+    auto i = tree_->right_[idx_];
+    return i < 0 ? tract_node{} : tract_node{tree_, i};
+  }
+  inline tract_node tract_node::parent() const {
+    auto i = tree_->parent_[idx_];
+    return i < 0 ? tract_node{} : tract_node{tree_, i};
+  }
 }//jhmi
 #endif
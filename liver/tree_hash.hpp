@@ -0,0 +1,126 @@
+#ifndef JHMI_LIVER_TREE_HASH_HPP_NRC_20261019
+#define JHMI_LIVER_TREE_HASH_HPP_NRC_20261019
+
+#include "liver/physical_vessel.hpp"
+#include "liver/utility.hpp"
+#include "utility/binary_tree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace jhmi {
+
+  namespace jhmi_detail {
+    //The finalizer of splitmix64.
+    inline std::uint64_t mix_hash(std::uint64_t h) {
+      h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9;
+      h = (h ^ (h >> 27)) * 0x94D049BB133111EB;
+      return h ^ (h >> 31);
+    }
+    inline std::uint64_t combine_hash(std::uint64_t seed, std::uint64_t v) {
+      return mix_hash(seed ^ (v + 0x9E3779B97F4A7C15 + (seed << 6) + (seed >> 2)));
+    }
+    //Values equal to within nearly_equal's tolerance usually round alike;
+    // those which don't are caught by comparing the vessels themselves.
+    inline std::uint64_t quantize(double v) { return std::uint64_t(std::llround(v * 1e6)); }
+
+    inline std::uint64_t hash_vessel(physical_vessel const& v) {
+      std::uint64_t h = std::uint64_t(v.id().value());
+      for (auto const& p : {v.start(), v.end()}) {
+        h = combine_hash(h, quantize(p.x.value()));
+        h = combine_hash(h, quantize(p.y.value()));
+        h = combine_hash(h, quantize(p.z.value()));
+      }
+      h = combine_hash(h, quantize(v.distance().value()));
+      h = combine_hash(h, quantize(v.radius().value()));
+      h = combine_hash(h, std::uint64_t(v.cell().value()));
+      h = combine_hash(h, quantize(v.flow().value()));
+      h = combine_hash(h, quantize(v.entry_pressure().value()));
+      h = combine_hash(h, quantize(v.exit_pressure().value()));
+      return combine_hash(h, v.is_const());
+    }
+  }
+
+  //Merkle hashes of a vessel tree: each vessel's covers its own values,
+  // quantized to the tolerance physical_vessel's operator== allows, and
+  // its children's hashes, so two trees (or subtrees) whose hashes match
+  // are equal, barring a collision.  Built in one post-order pass, or kept
+  // current by calling update on each changed vessel and its ancestors,
+  // children before parents, as physical_vessel_tree_updater does.
+  class vessel_tree_hashes {
+    std::vector<std::uint64_t> hashes_;//By vessel id.
+    std::uint64_t root_;
+
+  public:
+    static constexpr std::uint64_t no_child = 0x6A09E667F3BCC908;
+
+    vessel_tree_hashes() : root_{no_child} {}
+    explicit vessel_tree_hashes(binary_tree<physical_vessel> const& tree) : root_{no_child} {
+      RANGES_FOR(auto n, tree | view::node_post_order) {
+        reserve(std::size_t(n.value().id().value()));
+        update(n);
+      }
+    }
+
+    //Makes room for vessel ids up to max_id.
+    void reserve(std::size_t max_id) {
+      if (hashes_.size() <= max_id)
+        hashes_.resize(std::max(max_id + 1, 2 * hashes_.size()), no_child);
+    }
+    //Recomputes n's hash from its value and its children's hashes.  Calls
+    // for different vessels, with room already made for their ids, may run
+    // concurrently.
+    template <typename Node>
+    void update(Node n) {
+      auto child = [&](auto c) { return c ? hashes_[c.value().id().value()] : no_child; };
+      auto h = jhmi_detail::combine_hash(jhmi_detail::hash_vessel(n.value()), child(n.left_child()));
+      h = jhmi_detail::combine_hash(h, child(n.right_child()));
+      hashes_[n.value().id().value()] = h;
+      if (!n.parent())
+        root_ = h;
+    }
+
+    std::uint64_t root() const { return root_; }
+    //The hash of the subtree rooted at the vessel with this id.
+    std::uint64_t at(vessel_id id) const { return hashes_.at(std::size_t(id.value())); }
+  };
+
+  //Calls report(lhs, rhs) for each pair of corresponding vessels which
+  // differ between two trees, descending only into subtrees whose hashes
+  // differ.  Vessels correspond by position in the tree; where one tree
+  // has a subtree the other lacks, report gets its root and a null node.
+  // Returns the number of differences reported.
+  template <typename Report>
+  std::size_t diff_vessel_trees(
+      binary_const_node_t<physical_vessel> lhs, vessel_tree_hashes const& lhs_hashes,
+      binary_const_node_t<physical_vessel> rhs, vessel_tree_hashes const& rhs_hashes,
+      Report report) {
+    using node_t = binary_const_node_t<physical_vessel>;
+    std::size_t differences = 0;
+    std::vector<std::pair<node_t,node_t>> to_visit{{lhs, rhs}};
+    while (!to_visit.empty()) {
+      auto [l, r] = to_visit.back();
+      to_visit.pop_back();
+      if (!l && !r)
+        continue;
+      if (!l || !r) {
+        report(l, r);
+        ++differences;
+        continue;
+      }
+      if (lhs_hashes.at(l.value().id()) == rhs_hashes.at(r.value().id()))
+        continue;
+      if (!(l.value() == r.value())) {
+        report(l, r);
+        ++differences;
+      }
+      to_visit.emplace_back(l.right_child(), r.right_child());
+      to_visit.emplace_back(l.left_child(), r.left_child());
+    }
+    return differences;
+  }
+}//jhmi
+
+#endif
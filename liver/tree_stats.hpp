@@ -2,6 +2,7 @@
 #define JHMI_LIVER_PRINT_TREE_STATS_HPP_NRC_20171202
 
 #include "liver/macrocell_tree.hpp"
+#include "liver/tract_lattice.hpp"
 #include "utility/math.hpp"
 #include "utility/volume_image.hpp"
 
@@ -40,7 +41,7 @@ namespace jhmi {
     tree_stats ts;
     ts.gamma = tree.vessel_tree().gamma();
     ts.num_macrocells = terminal_radii.size();
-    ts.num_locations = ranges::distance(tracts_in(liver));
+    ts.num_locations = tract_lattice{liver}.size();
 
     ts.pha_radius = ranges::front(tree.vessel_tree().vessels()).radius();
     ts.pha_flow = ranges::front(tree.vessel_tree().vessels()).flow();
@@ -2,6 +2,7 @@
 #define JHMI_LIVER_UTILITY_HPP_NRC_20161011
 
 #include "utility/pt3.hpp"
+#include "utility/slot_map.hpp"
 #include "utility/tagged_int.hpp"
 #include <fmt/ostream.h>
 #include <unordered_map>
@@ -9,8 +10,10 @@
 namespace jhmi {
   struct load_tree_tag {};
   struct build_tree_tag {};
+  struct resume_build_tag {};
   static const constexpr load_tree_tag load_tree{};
   static const constexpr build_tree_tag build_tree{};
+  static const constexpr resume_build_tag resume_build{};
 
   struct cell_tag {};
   struct vessel_tag {};
@@ -18,7 +21,8 @@ namespace jhmi {
   using cell_id = tagged_int<cell_tag>;
   using vessel_id = tagged_int<vessel_tag>;
 
-  template <typename T> using vidx_to = std::unordered_map<vessel_id, T>;
+  //Ids are handed out densely, so maps keyed by them are stored by index.
+  template <typename T> using vidx_to = slot_map<vessel_id, T>;
   template <typename T> bool nearly_equal(T lhs, T rhs) {
     return abs(lhs - rhs).value() < 1e-6;
   }
@@ -0,0 +1,37 @@
+#ifndef JHMI_LIVER_VALIDATION_HPP_NRC_20261019
+#define JHMI_LIVER_VALIDATION_HPP_NRC_20261019
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace jhmi {
+  //How thoroughly a tree is checked after each growth cycle.  sampled checks
+  // a random fraction of vessels and cells each cycle, then everything once
+  // the build finishes.
+  enum class validation { off, sampled, full };
+
+  inline std::istream& operator>>(std::istream& in, validation& v) {
+    std::string s;
+    in >> s;
+    if (s == "off")
+      v = validation::off;
+    else if (s == "sampled")
+      v = validation::sampled;
+    else if (s == "full")
+      v = validation::full;
+    else
+      in.setstate(std::ios::failbit);
+    return in;
+  }
+  inline std::ostream& operator<<(std::ostream& out, validation v) {
+    switch (v) {
+      case validation::off: return out << "off";
+      case validation::sampled: return out << "sampled";
+      case validation::full: return out << "full";
+    }
+    return out;
+  }
+}
+
+#endif
@@ -2,12 +2,12 @@
 #define JHMI_LIVER_WALRAND_TREE_HPP_NRC_2016_02_02
 
 #include "liver/build_vessel_map.hpp"
+#include "liver/chunked_vessel_tree.hpp"
 #include "liver/distance_vessel.hpp"
 #include "messages/vessel_tree.pb.h"
 #include "shape/voxelized_shape.hpp"
 #include "utility/binary_tree.hpp"
 #include "utility/octtree.hpp"
-#include "utility/protobuf_zip_ostream.hpp"
 #include <boost/filesystem.hpp>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
@@ -98,7 +98,8 @@ namespace jhmi {
     }
 
     std::string write(boost::filesystem::path const& p) const {
-      jhmi_message::VesselTree vt;
+      std::string filename = "vessel_tree.pbz";
+      chunked_tree_writer vt{p / filename};
       RANGES_FOR(auto&& v, vessels_ | view::node_level_order) {
         auto p = v.parent();
         auto r = v.right_child();
@@ -121,10 +122,7 @@ namespace jhmi {
         vtv->set_ez(v.value().l.p2.z.value());
         vtv->set_is_const(false);
       }
-      std::string filename = "vessel_tree.pbz";
-      protobuf_zip_ostream out_stream{p / filename};
-      if (!vt.SerializeToZeroCopyStream(out_stream.get()))
-        throw std::runtime_error("Failed to write simple vessel tree.");
+      vt.close();
       return filename;
     }
   };
@@ -3,23 +3,89 @@
 
 #include "utility/volume_image.hpp"
 #include <range/v3/algorithm/count_if.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
 
 namespace jhmi {
 
   enum class adjust { do_nothing, do_open };
   class voxelized_shape {
     volume_image<std::uint8_t> img_;
+    //Runs [begin,end) of nonzero voxels along y, stored for each (x,z) column
+    // as runs_[run_starts_[x + z*w]] through runs_[run_starts_[x + z*w + 1]].
+    std::vector<std::size_t> run_starts_;
+    std::vector<std::pair<int,int>> runs_;
+    boost::filesystem::path filename_;
+    std::uint64_t hash_;
     friend cube<m3> extents(voxelized_shape const& s) { return extents(s.img_); }
+
+    //FNV-1a over the dimensions, extents and voxels.
+    void compute_hash() {
+      hash_ = 14695981039346656037ull;
+      auto add = [&](void const* data, std::size_t size) {
+        auto bytes = static_cast<unsigned char const*>(data);
+        for (std::size_t i = 0; i < size; ++i)
+          hash_ = (hash_ ^ bytes[i]) * 1099511628211ull;
+      };
+      auto d = img_.dimensions();
+      auto ext = extents(img_);
+      add(&d, sizeof(d));
+      double corners[] = {ext.ul().x.value(), ext.ul().y.value(), ext.ul().z.value(),
+                          ext.lr().x.value(), ext.lr().y.value(), ext.lr().z.value()};
+      add(corners, sizeof(corners));
+      add(img_.begin(), img_.end() - img_.begin());
+    }
+    void build_runs() {
+      auto d = img_.dimensions();
+      run_starts_.assign(std::size_t(d.x) * d.z + 1, 0);
+      runs_.clear();
+      for (int z = 0; z < d.z; ++z) {
+        for (int x = 0; x < d.x; ++x) {
+          run_starts_[x + z * d.x] = runs_.size();
+          for (int y = 0; y < d.y;) {
+            if (img_(x,y,z) == 0) {
+              ++y;
+              continue;
+            }
+            auto begin = y;
+            while (y < d.y && img_(x,y,z) != 0)
+              ++y;
+            runs_.emplace_back(begin, y);
+          }
+        }
+      }
+      run_starts_.back() = runs_.size();
+    }
   public:
-    voxelized_shape() : img_{int3{}, cube<m3>{}} {}
+    voxelized_shape() : img_{int3{}, cube<m3>{}} { build_runs(); compute_hash(); }
+    explicit voxelized_shape(volume_image<std::uint8_t> img) : img_{std::move(img)} {
+      build_runs();
+      compute_hash();
+    }
     explicit voxelized_shape(boost::filesystem::path const& filename, adjust adj = adjust::do_nothing)
-      : img_{filename} {
+      : img_{filename}, filename_{filename} {
       if (adj == adjust::do_open)
         img_ = dilate(erode(img_));
+      build_runs();
+      compute_hash();
     }
 
     bool operator()(m3 const& pt) const { return contains(extents(img_), pt) && img_(pt) != 0; }
 
+    //The file this shape was loaded from, empty if it was built in memory.
+    boost::filesystem::path const& filename() const { return filename_; }
+    //Identifies the shape's contents (after any adjustment).
+    std::uint64_t hash() const { return hash_; }
+
+    //The voxel operator() consults for pt; only meaningful if pt is within extents.
+    int3 voxel(m3 const& pt) const { return int3(img_.to_index(pt)); }
+    auto runs(int x, int z) const {
+      auto idx = std::size_t(x) + std::size_t(z) * img_.width();
+      return ranges::make_iterator_range(runs_.data() + run_starts_[idx],
+                                         runs_.data() + run_starts_[idx + 1]);
+    }
+
     cubic_meters volume() const {
       if (img_.width() == 0 || img_.height() == 0 || img_.depth() == 0)
         return cubic_meters{0};
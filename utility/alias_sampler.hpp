@@ -0,0 +1,79 @@
+#ifndef JHMI_UTILITY_ALIAS_SAMPLER_HPP_NRC_20261019
+#define JHMI_UTILITY_ALIAS_SAMPLER_HPP_NRC_20261019
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <vector>
+
+namespace jhmi {
+
+  //Draws index i with probability proportional to weight i, like
+  // std::discrete_distribution, but in O(1) using Vose's alias method.
+  // reset reuses the object's storage, so once it has seen its largest input
+  // it no longer allocates.
+  class alias_sampler {
+    std::vector<double> weights_;
+    std::vector<double> prob_;
+    std::vector<std::uint32_t> alias_;
+    std::vector<std::uint32_t> small_, large_;
+
+    void build() {
+      auto n = weights_.size();
+      prob_.resize(n);
+      alias_.resize(n);
+      small_.clear();
+      large_.clear();
+      auto sum = 0.;
+      for (auto w : weights_)
+        sum += w;
+      assert(sum > 0);
+      for (std::uint32_t i = 0; i < n; ++i) {
+        prob_[i] = weights_[i] * n / sum;
+        (prob_[i] < 1. ? small_ : large_).push_back(i);
+      }
+      while (!small_.empty() && !large_.empty()) {
+        auto s = small_.back(), l = large_.back();
+        small_.pop_back();
+        alias_[s] = l;
+        prob_[l] -= 1. - prob_[s];
+        if (prob_[l] < 1.) {
+          large_.pop_back();
+          small_.push_back(l);
+        }
+      }
+      //Whatever remains is 1 up to rounding.
+      for (auto i : large_)
+        prob_[i] = 1.;
+      for (auto i : small_)
+        prob_[i] = 1.;
+    }
+
+  public:
+    alias_sampler() = default;
+    template <typename It>
+    alias_sampler(It first, It last) { reset(first, last); }
+
+    template <typename It>
+    void reset(It first, It last) {
+      weights_.assign(first, last);
+      build();
+    }
+
+    std::size_t size() const { return weights_.size(); }
+    double weight(std::size_t i) const { return weights_[i]; }
+
+    template <typename Gen>
+    std::size_t operator()(Gen& gen) {
+      auto n = prob_.size();
+      std::uniform_real_distribution<double> uniform;
+      auto x = uniform(gen) * n;
+      auto k = std::min(std::size_t(x), n - 1);
+      return x - k < prob_[k] ? k : alias_[k];
+    }
+  };
+}
+
+#endif
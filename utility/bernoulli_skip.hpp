@@ -0,0 +1,28 @@
+#ifndef JHMI_UTILITY_BERNOULLI_SKIP_HPP_NRC_20261019
+#define JHMI_UTILITY_BERNOULLI_SKIP_HPP_NRC_20261019
+
+#include <cstddef>
+#include <random>
+
+namespace jhmi {
+
+  //Calls f(i), in increasing order, for each i in [0, n) chosen independently
+  // with probability p, just as drawing a Bernoulli variate per index would.
+  // The gaps between chosen indices are drawn instead, geometrically, so only
+  // about n * p + 1 variates are drawn rather than n.
+  template <typename Gen, typename F>
+  void for_each_bernoulli(std::size_t n, double p, Gen& gen, F f) {
+    if (!(p > 0))
+      return;
+    if (p >= 1) {
+      for (std::size_t i = 0; i < n; ++i)
+        f(i);
+      return;
+    }
+    std::geometric_distribution<std::size_t> skip{p};
+    for (auto i = skip(gen); i < n; i += skip(gen) + 1)
+      f(i);
+  }
+}
+
+#endif
@@ -4,15 +4,18 @@
 #include <random>
 
 namespace jhmi {
+  //Like the <random> distributions, these take the generator per call.  Each
+  // draw starts a fresh std::normal_distribution, which may cache a second
+  // value, so a draw depends only on the generator it's given; that keeps
+  // draws from per-sphere substreams independent of one another.
   struct gaussian_90_sampler {
-    std::mt19937& gen_;
-    std::normal_distribution<> dist_;
-    gaussian_90_sampler(std::mt19937& gen, m min_90_radius, m max_90_radius)
-      : gen_{gen},
-        dist_{((max_90_radius + min_90_radius) / 2.).value(),
-              ((max_90_radius - (max_90_radius + min_90_radius) / 2.) / 1.65).value()}
+    std::normal_distribution<>::param_type param_;
+    gaussian_90_sampler(m min_90_radius, m max_90_radius)
+      : param_{((max_90_radius + min_90_radius) / 2.).value(),
+               ((max_90_radius - (max_90_radius + min_90_radius) / 2.) / 1.65).value()}
     {}
-    auto operator()() { return dist_(gen_) * meters; }
+    template <typename Gen>
+    auto operator()(Gen& gen) const { return std::normal_distribution<>{param_}(gen) * meters; }
   };
   struct truncated_gaussian {
     gaussian_90_sampler sampler_;
@@ -20,12 +23,12 @@ namespace jhmi {
     boost::optional<m> max_radius_;
     truncated_gaussian(gaussian_90_sampler const& sampler, m min_radius, boost::optional<m> max_radius)
       : sampler_{sampler}, min_radius_{min_radius}, max_radius_{max_radius} {}
-    auto operator()() {
-      auto lb = std::max(sampler_(), min_radius_);
+    template <typename Gen>
+    auto operator()(Gen& gen) const {
+      auto lb = std::max(sampler_(gen), min_radius_);
       return max_radius_ ? std::min(lb, *max_radius_) : lb;
     }
   };
 }
 
 #endif
-
@@ -6,6 +6,8 @@
 #include <google/protobuf/io/gzip_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <boost/filesystem.hpp>
+#include <fmt/format.h>
+#include <stdexcept>
 
 #ifndef WIN32
 #include <sys/stat.h>
@@ -14,26 +16,40 @@
 
 namespace jhmi {
 
-  template <typename T>
-  T load_protobuf(boost::filesystem::path const& filename) {
+  //Calls read with a stream of the inflated contents of filename, after its
+  // first skip bytes, returning what it returns.
+  template <typename Read>
+  auto with_gzip_stream(boost::filesystem::path const& filename, Read read, int skip = 0) {
     namespace io = google::protobuf::io;
 #ifndef WIN32
     auto fd = open(filename.string().c_str(), O_RDONLY, S_IREAD);
-    if (!fd)
-      throw std::runtime_error("open failed on output file");
+    if (fd == -1)
+      throw std::runtime_error(fmt::format("Unable to open {}", filename.string()));
     auto ex = scope_exit([&] { close(fd); });
     auto file_stream = std::make_unique<io::FileInputStream>(fd);
 #else
     auto f = std::ifstream{filename.string(), std::ios::binary};
+    if (!f)
+      throw std::runtime_error(fmt::format("Unable to open {}", filename.string()));
     auto file_stream = std::make_unique<io::IstreamInputStream>(&f);
 #endif
-    io::GzipInputStream gzip_stream{file_stream.get()};
-    auto cs = std::make_unique<io::CodedInputStream>(&gzip_stream);
-    cs->SetTotalBytesLimit(1024*1024*1024, 1024*1024*1024);
-    T vt;
-    if (!vt.ParseFromCodedStream(cs.get()))
+    if (skip > 0 && !file_stream->Skip(skip))
       throw std::runtime_error("Invalid pb file");
-    return vt;
+    io::GzipInputStream gzip_stream{file_stream.get()};
+    return read(gzip_stream);
+  }
+
+  template <typename T>
+  T load_protobuf(boost::filesystem::path const& filename, int skip = 0) {
+    namespace io = google::protobuf::io;
+    return with_gzip_stream(filename, [](io::ZeroCopyInputStream& in) {
+      auto cs = std::make_unique<io::CodedInputStream>(&in);
+      cs->SetTotalBytesLimit(1024*1024*1024, 1024*1024*1024);
+      T vt;
+      if (!vt.ParseFromCodedStream(cs.get()))
+        throw std::runtime_error("Invalid pb file");
+      return vt;
+    }, skip);
   }
 }
 #endif
@@ -1,26 +1,43 @@
 #ifndef JHMI_UTILITY_MAKE_BALANCED_SAMPLER_HPP_NRC_20160805
 #define JHMI_UTILITY_MAKE_BALANCED_SAMPLER_HPP_NRC_20160805
 
-#include <boost/container/flat_map.hpp>
-#include <range/v3/algorithm.hpp>
-#include <range/v3/view.hpp>
+#include "utility/alias_sampler.hpp"
+#include <algorithm>
+#include <vector>
 
 namespace jhmi {
 
-  auto make_balanced_sampler(std::vector<int> const& values) {
-    auto hist = boost::container::flat_map<int,int>{};
-    for (auto&& v : values)
-      ++hist[v];
-    auto desired_pct = 1. / hist.size();
-    auto all_sum = ranges::accumulate(hist | ranges::view::values, 0);
-    auto weight_table = boost::container::flat_map<int, double>{};
-    for (auto&& h : hist)
-      weight_table.insert(std::make_pair(h.first, desired_pct * all_sum / h.second));
-    auto weights = values | ranges::view::transform([&](int i) { return weight_table[i]; });
-
-    return std::discrete_distribution<>(weights.begin(), weights.end());
-    //auto ones = std::vector<double>(hist.size(), 1.);
-    //return std::discrete_distribution<>(ones.begin(), ones.end());
+  //Draws index i with probability inversely proportional to how many of the
+  // values equal values[i], so each distinct value is equally likely.  Reusing
+  // one sampler via reset avoids allocating once it has seen its largest input.
+  class balanced_sampler {
+    alias_sampler alias_;
+    std::vector<int> sorted_;
+    std::vector<double> weights_;
+  public:
+    balanced_sampler() = default;
+    explicit balanced_sampler(std::vector<int> const& values) { reset(values); }
+
+    template <typename Range>
+    void reset(Range const& values) {
+      sorted_.assign(values.begin(), values.end());
+      std::sort(sorted_.begin(), sorted_.end());
+      weights_.clear();
+      for (int v : values) {
+        auto r = std::equal_range(sorted_.begin(), sorted_.end(), v);
+        weights_.push_back(1. / (r.second - r.first));
+      }
+      alias_.reset(weights_.begin(), weights_.end());
+    }
+
+    std::size_t size() const { return alias_.size(); }
+
+    template <typename Gen>
+    std::size_t operator()(Gen& gen) { return alias_(gen); }
+  };
+
+  inline balanced_sampler make_balanced_sampler(std::vector<int> const& values) {
+    return balanced_sampler{values};
   }
 }
 
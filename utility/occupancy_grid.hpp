@@ -0,0 +1,169 @@
+#ifndef JHMI_UTILITY_OCCUPANCY_GRID_HPP_NRC_20261019
+#define JHMI_UTILITY_OCCUPANCY_GRID_HPP_NRC_20261019
+
+#include "utility/cube.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace jhmi {
+
+  //Tracks which sites of a dense integer lattice exist and which are occupied.
+  // Each index within bounds (half-open, as with traverse) maps to a linear id
+  // (x fastest), and both properties are stored as bitsets.  A summary bit per
+  // 64-site word records whether that word holds any free site (present and
+  // unoccupied), so searching a block for free sites is mostly word operations.
+  class occupancy_grid {
+    using word = std::uint64_t;
+    static constexpr std::size_t word_bits = 64;
+
+    cube<int3> bounds_;
+    int3 dims_;
+    std::vector<word> sites_;
+    std::vector<word> occupied_;
+    std::vector<word> has_free_;
+    std::vector<std::uint32_t> site_ranks_;//Sites before each word, see index_sites.
+
+    static std::size_t num_words(std::size_t bits) { return (bits + word_bits - 1) / word_bits; }
+    void update_summary(std::size_t w) {
+      auto bit = word{1} << (w % word_bits);
+      if (sites_[w] & ~occupied_[w])
+        has_free_[w / word_bits] |= bit;
+      else
+        has_free_[w / word_bits] &= ~bit;
+    }
+    std::size_t checked_id(int3 const& idx) const {
+      if (!contains(idx)) {
+        throw std::runtime_error(fmt::format("Lattice index ({},{},{}) outside occupancy grid",
+          idx.x, idx.y, idx.z));
+      }
+      return to_id(idx);
+    }
+    //True if any id in [first, last) is free.
+    bool any_free(std::size_t first, std::size_t last) const {
+      auto free_bits = [&](std::size_t w) { return sites_[w] & ~occupied_[w]; };
+      auto fw = first / word_bits, lw = (last - 1) / word_bits;
+      auto head = ~word{0} << (first % word_bits);
+      auto tail = ~word{0} >> (word_bits - 1 - (last - 1) % word_bits);
+      if (fw == lw)
+        return (free_bits(fw) & head & tail) != 0;
+      if ((free_bits(fw) & head) || (free_bits(lw) & tail))
+        return true;
+      //Whole words in between only need their summary bits.
+      for (auto w = fw + 1; w < lw;) {
+        auto s = has_free_[w / word_bits] >> (w % word_bits);
+        auto n = std::min(word_bits - w % word_bits, lw - w);
+        if (n < word_bits)
+          s &= (word{1} << n) - 1;
+        if (s)
+          return true;
+        w += n;
+      }
+      return false;
+    }
+
+  public:
+    occupancy_grid() : occupancy_grid(cube<int3>{}) {}
+    explicit occupancy_grid(cube<int3> const& bounds)
+      : bounds_{bounds}, dims_{dimensions(bounds)},
+        sites_(num_words(size())), occupied_(sites_.size()),
+        has_free_(num_words(sites_.size())) {}
+
+    cube<int3> const& bounds() const { return bounds_; }
+    std::size_t size() const { return std::size_t(dims_.x) * dims_.y * dims_.z; }
+
+    bool contains(int3 const& idx) const {
+      return idx.x >= bounds_.ul().x && idx.y >= bounds_.ul().y && idx.z >= bounds_.ul().z
+          && idx.x < bounds_.lr().x && idx.y < bounds_.lr().y && idx.z < bounds_.lr().z;
+    }
+    std::size_t to_id(int3 const& idx) const {
+      auto p = idx - bounds_.ul();
+      return p.x + dims_.x * (std::size_t(p.y) + std::size_t(dims_.y) * p.z);
+    }
+    int3 from_id(std::size_t id) const {
+      int x = id % dims_.x;
+      id /= dims_.x;
+      return bounds_.ul() + int3{x, int(id % dims_.y), int(id / dims_.y)};
+    }
+
+    bool is_site(int3 const& idx) const {
+      if (!contains(idx))
+        return false;
+      auto id = to_id(idx);
+      return (sites_[id / word_bits] >> (id % word_bits)) & 1;
+    }
+    bool is_occupied(int3 const& idx) const {
+      if (!contains(idx))
+        return false;
+      auto id = to_id(idx);
+      return (occupied_[id / word_bits] >> (id % word_bits)) & 1;
+    }
+    bool is_free(int3 const& idx) const { return is_site(idx) && !is_occupied(idx); }
+
+    void add_site(int3 const& idx) {
+      auto id = checked_id(idx);
+      sites_[id / word_bits] |= word{1} << (id % word_bits);
+      update_summary(id / word_bits);
+    }
+    void clear_sites() {
+      std::fill(sites_.begin(), sites_.end(), word{0});
+      std::fill(has_free_.begin(), has_free_.end(), word{0});
+      site_ranks_.clear();
+    }
+    //Numbers the sites 0..num_sites()-1 in id order, for site_rank.  Must be
+    // called again after sites are added.
+    void index_sites() {
+      site_ranks_.resize(sites_.size() + 1);
+      std::uint32_t count = 0;
+      for (std::size_t w = 0; w < sites_.size(); ++w) {
+        site_ranks_[w] = count;
+        count += __builtin_popcountll(sites_[w]);
+      }
+      site_ranks_.back() = count;
+    }
+    std::size_t num_sites() const { return site_ranks_.empty() ? 0 : site_ranks_.back(); }
+    //The number of sites with smaller ids than the site at idx.
+    std::size_t site_rank(int3 const& idx) const {
+      assert(is_site(idx) && !site_ranks_.empty());
+      auto id = to_id(idx);
+      auto below = (word{1} << (id % word_bits)) - 1;
+      return site_ranks_[id / word_bits] + __builtin_popcountll(sites_[id / word_bits] & below);
+    }
+    void occupy(int3 const& idx) {
+      auto id = checked_id(idx);
+      occupied_[id / word_bits] |= word{1} << (id % word_bits);
+      update_summary(id / word_bits);
+    }
+    void release(int3 const& idx) {
+      if (!contains(idx))
+        return;
+      auto id = to_id(idx);
+      occupied_[id / word_bits] &= ~(word{1} << (id % word_bits));
+      update_summary(id / word_bits);
+    }
+
+    //True if any site within block (half-open, clipped to bounds) is free.
+    bool any_free(cube<int3> const& block) const {
+      auto ul = int3{std::max(block.ul().x, bounds_.ul().x), std::max(block.ul().y, bounds_.ul().y),
+                     std::max(block.ul().z, bounds_.ul().z)};
+      auto lr = int3{std::min(block.lr().x, bounds_.lr().x), std::min(block.lr().y, bounds_.lr().y),
+                     std::min(block.lr().z, bounds_.lr().z)};
+      if (ul.x >= lr.x || ul.y >= lr.y || ul.z >= lr.z)
+        return false;
+      auto row_length = std::size_t(lr.x - ul.x);
+      for (int z = ul.z; z < lr.z; ++z) {
+        for (int y = ul.y; y < lr.y; ++y) {
+          auto first = to_id(int3{ul.x, y, z});
+          if (any_free(first, first + row_length))
+            return true;
+        }
+      }
+      return false;
+    }
+  };
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <tbb/tbb.h>
 #include <unordered_set>
 #include <deque>
+#include <vector>
 
 namespace jhmi {
   struct normal_distance_squared {
@@ -77,8 +78,10 @@ namespace jhmi {
         return rhs;
       }
     };
+    //Ties are broken by the items themselves, so the result doesn't depend
+    // on the order the nodes are searched in.
     struct best_vector_pts {
-      boost::container::flat_map<m_sq, T> objs_;
+      boost::container::flat_set<std::pair<m_sq, T>> objs_;
       int n_;
       explicit best_vector_pts(int n) : n_(n) {}
       void consider(T const& t, m_sq d) {
@@ -192,7 +195,8 @@ namespace jhmi {
     std::vector<T> find_n_nearest_items(m3 const& pt, int n, F dist_sq = F{}) const {
       auto best = best_vector_pts{n};
       find_at_level(pt, node_, best, dist_sq);
-      return best.objs_ | ranges::view::values | ranges::to_vector;
+      return best.objs_ | ranges::view::transform([](auto const& p) { return p.second; })
+        | ranges::to_vector;
     }
 
     template <typename F = normal_distance_squared>
@@ -204,6 +208,21 @@ namespace jhmi {
       return boost::none;
     }
 
+    //Calls f on every item, in no particular order.
+    template <typename F>
+    void for_each_item(F f) const {
+      std::vector<node const*> nodes{&node_};
+      while (!nodes.empty()) {
+        auto curr = nodes.back();
+        nodes.pop_back();
+        for (auto&& repr : curr->objs)
+          f(repr);
+        if (curr->sub_nodes) {
+          for (int i = 0; i < 8; ++i)
+            nodes.push_back(&curr->sub_nodes[i]);
+        }
+      }
+    }
     auto get_all() const {
       boost::container::flat_set<decltype(id(std::declval<T>()))> ret;
       std::deque<node const*> nodes{&node_};
@@ -72,7 +72,7 @@ namespace jhmi {
     void init(boost::program_options::options_description& desc) {
       desc.add_options()("treefiles,t",
         boost::program_options::value<std::vector<std::string>>()->required()->multitoken(),
-        "pb files with hepatic artery trees and macrocells");
+        "pb files (or delta snapshots) with hepatic artery trees and macrocells");
     }
     void parse(boost::program_options::variables_map const& vm) {
       ranges::transform(vm["treefiles"].as<std::vector<std::string>>(),
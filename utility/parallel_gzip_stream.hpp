@@ -0,0 +1,120 @@
+#ifndef JHMI_UTILITY_PARALLEL_GZIP_STREAM_HPP_NRC_20261019
+#define JHMI_UTILITY_PARALLEL_GZIP_STREAM_HPP_NRC_20261019
+
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <tbb/tbb.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace jhmi {
+
+  //Gzips what's written to it onto out, pigz style: the input is split into
+  // fixed size blocks, batches of which are compressed in parallel, each
+  // into a gzip member of its own, and the members are written in order.
+  // gzip (and GzipInputStream) reads concatenated members as one stream, so
+  // the output reads back like that of a single GzipOutputStream, at the
+  // cost of a little compression lost at each block boundary.
+  //
+  //Close, or destruction, writes out the last batch.
+  class parallel_gzip_stream : public google::protobuf::io::ZeroCopyOutputStream {
+    std::ostream& out_;
+    std::size_t block_size_;
+    std::size_t batch_size_;
+    std::vector<std::string> blocks_;//The last is being filled.
+    std::vector<std::string> zipped_;
+    std::size_t used_;//Bytes of the last block handed out.
+    std::int64_t byte_count_;
+    bool failed_;
+    bool closed_;
+
+    static bool compress(std::string const& in, std::string& out) {
+      namespace io = google::protobuf::io;
+      out.clear();
+      io::StringOutputStream string_stream{&out};
+      io::GzipOutputStream::Options options;
+      options.format = io::GzipOutputStream::GZIP;
+      io::GzipOutputStream gzip_stream{&string_stream, options};
+      std::size_t pos = 0;
+      while (pos < in.size()) {
+        void* data;
+        int size;
+        if (!gzip_stream.Next(&data, &size))
+          return false;
+        auto n = std::min(std::size_t(size), in.size() - pos);
+        std::memcpy(data, in.data() + pos, n);
+        pos += n;
+        if (n < std::size_t(size))
+          gzip_stream.BackUp(int(std::size_t(size) - n));
+      }
+      return gzip_stream.Close();
+    }
+    void write_batch() {
+      if (!blocks_.empty())
+        blocks_.back().resize(used_);
+      zipped_.resize(blocks_.size());
+      auto ok = tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, blocks_.size(), 1), true,
+        [&](tbb::blocked_range<std::size_t> const& r, bool ok) {
+          for (auto i = r.begin(); i < r.end(); ++i)
+            ok = (blocks_[i].empty() || compress(blocks_[i], zipped_[i])) && ok;
+          return ok;
+        }, [](bool a, bool b) { return a && b; });
+      for (std::size_t i = 0; ok && i < blocks_.size(); ++i) {
+        if (!blocks_[i].empty())
+          out_.write(zipped_[i].data(), zipped_[i].size());
+      }
+      failed_ = failed_ || !ok || !out_;
+      blocks_.clear();
+      used_ = 0;
+    }
+
+  public:
+    explicit parallel_gzip_stream(std::ostream& out, std::size_t block_size = 256 * 1024)
+      : out_(out), block_size_{std::max(block_size, std::size_t(1))},
+        batch_size_{4 * std::max(std::size_t(std::thread::hardware_concurrency()), std::size_t(1))},
+        used_{0}, byte_count_{0}, failed_{false}, closed_{false} {}
+    parallel_gzip_stream(parallel_gzip_stream const&) = delete;
+    parallel_gzip_stream& operator=(parallel_gzip_stream const&) = delete;
+    ~parallel_gzip_stream() override { Close(); }
+
+    bool Next(void** data, int* size) override {
+      if (failed_ || closed_)
+        return false;
+      if (blocks_.empty() || used_ == block_size_) {
+        if (blocks_.size() == batch_size_)
+          write_batch();
+        blocks_.emplace_back(block_size_, '\0');
+        used_ = 0;
+      }
+      *data = &blocks_.back()[used_];
+      *size = int(block_size_ - used_);
+      used_ = block_size_;
+      byte_count_ += *size;
+      return true;
+    }
+    void BackUp(int count) override {
+      used_ -= count;
+      byte_count_ -= count;
+    }
+    google::protobuf::int64 ByteCount() const override { return byte_count_; }
+
+    //Compresses and writes whatever's left; false if anything failed.
+    bool Close() {
+      if (!closed_) {
+        write_batch();
+        out_.flush();
+        failed_ = failed_ || !out_;
+        closed_ = true;
+      }
+      return !failed_;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef JHMI_UTILITY_PHILOX_HPP_NRC_20261019
+#define JHMI_UTILITY_PHILOX_HPP_NRC_20261019
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace jhmi {
+
+  //The Philox4x32-10 counter-based generator of Salmon et al., "Parallel
+  // random numbers: as easy as 1, 2, 3" (SC '11).  Each output block is a
+  // keyed bijection of a 128-bit counter, so any position of any stream can
+  // be computed directly rather than by stepping through everything before it.
+  //
+  //The key is the seed; the counter holds the block number in its low half
+  // and a stream id in its high half.  substream(id) derives a child stream
+  // from this stream's id and the given one, so work can be keyed by what it
+  // is (a cycle, a cell, a try) instead of by the order it runs in.  Child
+  // stream ids are 64-bit hashes, so distinct keys collide only with
+  // probability about n^2 / 2^65 over n substreams.
+  //
+  //Meets the UniformRandomBitGenerator requirements, so it may be used with
+  // the <random> distributions in place of std::mt19937.
+  class philox4x32 {
+  public:
+    using result_type = std::uint32_t;
+    using counter_type = std::array<std::uint32_t, 4>;
+    using key_type = std::array<std::uint32_t, 2>;
+
+  private:
+    key_type key_;
+    std::uint64_t stream_;
+    std::uint64_t block_;//The next block to generate.
+    counter_type out_;
+    unsigned idx_;//Next unused word of out_; 4 when it's exhausted.
+
+    static constexpr std::uint32_t lo(std::uint64_t v) { return std::uint32_t(v); }
+    static constexpr std::uint32_t hi(std::uint64_t v) { return std::uint32_t(v >> 32); }
+    static constexpr std::uint64_t join(std::uint32_t l, std::uint32_t h) {
+      return std::uint64_t(h) << 32 | l;
+    }
+    static counter_type round(counter_type const& c, key_type const& k) {
+      auto p0 = std::uint64_t(0xD2511F53) * c[0];
+      auto p1 = std::uint64_t(0xCD9E8D57) * c[2];
+      return {hi(p1) ^ c[1] ^ k[0], lo(p1), hi(p0) ^ c[3] ^ k[1], lo(p0)};
+    }
+    counter_type block(std::uint64_t n) const {
+      return generate_block({lo(n), hi(n), lo(stream_), hi(stream_)}, key_);
+    }
+    //The number of outputs drawn so far.
+    std::uint64_t position() const { return block_ * 4 - (4 - idx_); }
+    philox4x32(key_type const& key, std::uint64_t stream)
+      : key_{key}, stream_{stream}, block_{0}, out_{}, idx_{4} {}
+
+  public:
+    explicit philox4x32(std::uint64_t seed = 0) : philox4x32{key_type{lo(seed), hi(seed)}, 0} {}
+
+    //The raw bijection; exposed for known-answer tests.
+    static counter_type generate_block(counter_type ctr, key_type key) {
+      for (int r = 0; r < 10; ++r) {
+        if (r > 0) {
+          key[0] += 0x9E3779B9;
+          key[1] += 0xBB67AE85;
+        }
+        ctr = round(ctr, key);
+      }
+      return ctr;
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() {
+      if (idx_ == 4) {
+        out_ = block(block_++);
+        idx_ = 0;
+      }
+      return out_[idx_++];
+    }
+    void discard(unsigned long long n) {
+      auto pos = position() + n;
+      block_ = pos / 4;
+      idx_ = 4;
+      if (pos % 4 != 0) {
+        out_ = block(block_++);
+        idx_ = unsigned(pos % 4);
+      }
+    }
+
+    //A stream, keyed by this one and id, which starts from its beginning.
+    // Ids are hashed under the complemented key, so they don't coincide with
+    // any of this stream's outputs.
+    philox4x32 substream(std::uint64_t id) const {
+      auto h = generate_block({lo(id), hi(id), lo(stream_), hi(stream_)},
+                              key_type{~key_[0], ~key_[1]});
+      return philox4x32{key_, join(h[0], h[1])};
+    }
+    template <typename... Ids>
+    philox4x32 substream(std::uint64_t id, Ids... ids) const {
+      return substream(id).substream(std::uint64_t(ids)...);
+    }
+
+    friend bool operator==(philox4x32 const& a, philox4x32 const& b) {
+      return a.key_ == b.key_ && a.stream_ == b.stream_ && a.position() == b.position();
+    }
+    friend bool operator!=(philox4x32 const& a, philox4x32 const& b) { return !(a == b); }
+  };
+}
+
+#endif
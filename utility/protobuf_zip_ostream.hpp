@@ -1,9 +1,13 @@
 #ifndef JHMI_UTILITY_PROTOBUF_ZIP_OSTREAM_HPP_NRC_20160909
 #define JHMI_UTILITY_PROTOBUF_ZIP_OSTREAM_HPP_NRC_20160909
 
+#include "utility/parallel_gzip_stream.hpp"
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/gzip_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <memory>
 //#ifndef WIN32
 #if 0
 # include <sys/stat.h>
@@ -11,6 +15,8 @@
 #endif
 
 namespace jhmi {
+  //A gzipped output file for protobuf messages.  Compression is spread over
+  // all cores; see parallel_gzip_stream.
   class protobuf_zip_ostream {
 //#ifndef WIN32
 #if 0
@@ -18,9 +24,8 @@ namespace jhmi {
     std::unique_ptr<google::protobuf::io::FileOutputStream> file_stream_;
 #else
     std::ofstream f_;
-    std::unique_ptr<google::protobuf::io::OstreamOutputStream> file_stream_;
 #endif
-    std::unique_ptr<google::protobuf::io::GzipOutputStream> out_stream_;
+    std::unique_ptr<parallel_gzip_stream> out_stream_;
 
   public:
     protobuf_zip_ostream(boost::filesystem::path const& filename) {
@@ -34,16 +39,18 @@ namespace jhmi {
       file_stream_ = std::make_unique<io::FileOutputStream>(fd_);
 #else
       f_ = std::ofstream{filename.string(), std::ios::binary};
-      file_stream_ = std::make_unique<io::OstreamOutputStream>(&f_);
 #endif
-      io::GzipOutputStream::Options options;
-      options.format = io::GzipOutputStream::GZIP;
-      out_stream_ = std::make_unique<io::GzipOutputStream>(file_stream_.get(), options);
+      out_stream_ = std::make_unique<parallel_gzip_stream>(f_);
   }
 
   auto get() const {
     return out_stream_.get();
   }
+  //Finishes the file, which otherwise happens on destruction; false if
+  // writing failed.
+  bool close() {
+    return out_stream_->Close();
+  }
 
   ~protobuf_zip_ostream() {
 //#ifndef WIN32
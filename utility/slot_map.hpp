@@ -0,0 +1,137 @@
+#ifndef JHMI_UTILITY_SLOT_MAP_HPP_NRC_20261019
+#define JHMI_UTILITY_SLOT_MAP_HPP_NRC_20261019
+
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace jhmi {
+
+  //A map keyed by small non-negative integer ids, such as those id_generator
+  // hands out, which keeps its values in a vector indexed by id.  Lookups are
+  // array indexing and iteration (in id order) walks contiguous slots.  Ids
+  // are never handed out twice, so unlike a general slot map it needs no
+  // free list or generation count to catch stale keys: an erased id's slot
+  // just stays empty.  Provides the parts of std::unordered_map's interface
+  // the trees use, and like it, at throws std::out_of_range for missing ids.
+  template <typename Id, typename T>
+  class slot_map {
+  public:
+    using key_type = Id;
+    using mapped_type = T;
+    using value_type = std::pair<Id, T>;
+    using size_type = std::size_t;
+
+  private:
+    using slots_t = std::vector<boost::optional<value_type>>;
+    slots_t slots_;
+    size_type size_ = 0;
+
+    static bool in_range(Id id, slots_t const& slots) {
+      return id.value() >= 0 && std::size_t(id.value()) < slots.size();
+    }
+
+    template <bool Const>
+    class iterator_t {
+      friend class slot_map;
+      friend class iterator_t<!Const>;
+      using slots_ptr = std::conditional_t<Const, slots_t const*, slots_t*>;
+      slots_ptr slots_ = nullptr;
+      std::size_t i_ = 0;
+
+      iterator_t(slots_ptr slots, std::size_t i) : slots_{slots}, i_{i} { skip(); }
+      void skip() {
+        while (i_ < slots_->size() && !(*slots_)[i_])
+          ++i_;
+      }
+
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = slot_map::value_type;
+      using difference_type = std::ptrdiff_t;
+      using reference = std::conditional_t<Const, value_type const&, value_type&>;
+      using pointer = std::conditional_t<Const, value_type const*, value_type*>;
+
+      iterator_t() = default;
+      template <bool C = Const, typename = std::enable_if_t<C>>
+      iterator_t(iterator_t<false> const& it) : slots_{it.slots_}, i_{it.i_} {}
+
+      reference operator*() const { return *(*slots_)[i_]; }
+      pointer operator->() const { return &**this; }
+      iterator_t& operator++() {
+        ++i_;
+        skip();
+        return *this;
+      }
+      iterator_t operator++(int) {
+        auto it = *this;
+        ++*this;
+        return it;
+      }
+      friend bool operator==(iterator_t const& l, iterator_t const& r) { return l.i_ == r.i_; }
+      friend bool operator!=(iterator_t const& l, iterator_t const& r) { return l.i_ != r.i_; }
+    };
+
+  public:
+    using iterator = iterator_t<false>;
+    using const_iterator = iterator_t<true>;
+
+    iterator begin() { return {&slots_, 0}; }
+    iterator end() { return {&slots_, slots_.size()}; }
+    const_iterator begin() const { return {&slots_, 0}; }
+    const_iterator end() const { return {&slots_, slots_.size()}; }
+
+    size_type size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    void clear() {
+      slots_.clear();
+      size_ = 0;
+    }
+    //Makes room for ids below n.
+    void reserve(size_type n) { slots_.reserve(n); }
+
+    size_type count(Id id) const { return in_range(id, slots_) && slots_[id.value()] ? 1 : 0; }
+    iterator find(Id id) { return count(id) ? iterator{&slots_, std::size_t(id.value())} : end(); }
+    const_iterator find(Id id) const {
+      return count(id) ? const_iterator{&slots_, std::size_t(id.value())} : end();
+    }
+    T& at(Id id) {
+      if (!count(id))
+        throw std::out_of_range("slot_map::at: no value for id");
+      return slots_[id.value()]->second;
+    }
+    T const& at(Id id) const {
+      if (!count(id))
+        throw std::out_of_range("slot_map::at: no value for id");
+      return slots_[id.value()]->second;
+    }
+
+    //As with std::unordered_map, an existing value is left in place.
+    std::pair<iterator,bool> insert(value_type const& v) {
+      if (v.first.value() < 0)
+        throw std::out_of_range("slot_map::insert: negative id");
+      auto i = std::size_t(v.first.value());
+      if (i >= slots_.size())
+        slots_.resize(std::max(i + 1, 2 * slots_.size()));
+      if (slots_[i])
+        return {iterator{&slots_, i}, false};
+      slots_[i] = v;
+      ++size_;
+      return {iterator{&slots_, i}, true};
+    }
+    size_type erase(Id id) {
+      if (!count(id))
+        return 0;
+      slots_[id.value()] = boost::none;
+      --size_;
+      return 1;
+    }
+  };
+}
+
+#endif
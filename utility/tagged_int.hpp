@@ -35,6 +35,8 @@ namespace jhmi {
     explicit id_generator(tagged_int<Tag> const& t) : i_(t.i_ + 1) {}
 
     auto operator()() { return tagged_int<Tag>{i_++}; }
+    //The most recent id handed out, or invalid if there's been none.
+    auto last() const { return tagged_int<Tag>{i_ - 1}; }
   };
 
   template <typename Tag>
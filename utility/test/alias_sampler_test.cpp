@@ -0,0 +1,34 @@
+#include "utility/alias_sampler.hpp"
+#include <random>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+namespace {
+  template <typename Sampler>
+  std::vector<double> frequencies(Sampler& s, std::mt19937& gen, int n) {
+    auto r = std::vector<double>(s.size(), 0.);
+    for (int i = 0; i < n; ++i)
+      ++r[s(gen)];
+    for (auto& v : r)
+      v /= n;
+    return r;
+  }
+}
+
+TEST_CASE( "Alias sampler matches weights", "[utility]" ) {
+  std::mt19937 gen(10);
+  auto w = std::vector<double>{1, 0, 3, 2, .5, 0, 8};
+  auto s = alias_sampler{w.begin(), w.end()};
+  auto r = frequencies(s, gen, 4'000'000);
+  for (std::size_t i = 0; i < w.size(); ++i)
+    REQUIRE(std::abs(r[i] - w[i] / 14.5) < 1e-3);
+
+  //Reset in place with a different size.
+  w = {2, 2};
+  s.reset(w.begin(), w.end());
+  r = frequencies(s, gen, 1'000'000);
+  REQUIRE(std::abs(r[0] - .5) < 1e-3);
+}
@@ -0,0 +1,41 @@
+#include "utility/bernoulli_skip.hpp"
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+TEST_CASE( "Geometric skips select each index with probability p", "[utility]" ) {
+  std::mt19937 gen(7);
+  const std::size_t n = 50;
+  const int trials = 200'000;
+  bool in_range = true;
+  for (double p : {.01, .3, .9}) {
+    std::vector<int> hits(n, 0);
+    std::vector<int> pairs(n, 0);//Index i and i+1 both chosen.
+    for (int t = 0; t < trials; ++t) {
+      std::size_t last = n;
+      for_each_bernoulli(n, p, gen, [&](std::size_t i) {
+        in_range = in_range && i < n;
+        ++hits[i];
+        if (last + 1 == i)
+          ++pairs[last];
+        last = i;
+      });
+    }
+    for (std::size_t i = 0; i < n; ++i)
+      REQUIRE(std::abs(hits[i] / double(trials) - p) < 5 * std::sqrt(p * (1-p) / trials));
+    //Neighbors are chosen independently.
+    for (std::size_t i = 0; i + 1 < n; ++i)
+      REQUIRE(std::abs(pairs[i] / double(trials) - p*p) < 5 * std::sqrt(p*p * (1-p*p) / trials));
+  }
+
+  REQUIRE(in_range);
+
+  int count = 0;
+  for_each_bernoulli(n, 0., gen, [&](std::size_t) { ++count; });
+  REQUIRE(count == 0);
+  for_each_bernoulli(n, 1., gen, [&](std::size_t) { ++count; });
+  REQUIRE(count == int(n));
+}
@@ -1,5 +1,8 @@
 #include "utility/interp.hpp"
 
+#include <cstring>
+#include <random>
+
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
@@ -17,3 +20,22 @@ TEST_CASE( "Interpolation test?", "[volume_image]" ) {
   REQUIRE(std::abs(lerp(img, dbl3{.7,1.1,1.5}*mm) - 5.4) < 1e-12);
   REQUIRE(std::abs(lerp(img, dbl3{.7,1.1,.9}*mm) - 3) < 1e-12);
 }
+
+TEST_CASE( "Batched interpolation matches scalar", "[volume_image]" ) {
+  auto img = volume_image<double>{int3{7,5,3}, cube<m3>{dbl3{-1,2,.5}*mm, dbl3{4,6,2}*mm}};
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(-3, 8);
+  std::generate(img.begin(), img.end(), [&] { return dist(gen); });
+
+  //Includes points outside the image and an odd count to exercise the tail.
+  std::vector<m3> pts;
+  for (int i = 0; i < 10001; ++i)
+    pts.push_back(dbl3{dist(gen), dist(gen), dist(gen)}*mm);
+  auto batched = lerp(img, pts);
+
+  REQUIRE(batched.size() == pts.size());
+  for (std::size_t i = 0; i < pts.size(); ++i) {
+    auto expected = lerp(img, pts[i]);
+    REQUIRE(std::memcmp(&expected, &batched[i], sizeof(double)) == 0);
+  }
+}
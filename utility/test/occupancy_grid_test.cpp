@@ -0,0 +1,58 @@
+#include "utility/occupancy_grid.hpp"
+#include <random>
+#include <set>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+TEST_CASE( "Occupancy grid ids", "[occupancy_grid]" ) {
+  auto grid = occupancy_grid{cube<int3>{int3{-2,-3,1}, int3{5,4,3}}};
+  REQUIRE(grid.size() == 7*7*2);
+  traverse(grid.bounds(), 1, [&](int3 const& idx) {
+    REQUIRE(grid.from_id(grid.to_id(idx)) == idx);
+  });
+  REQUIRE(grid.to_id(int3{-2,-3,1}) == 0);
+  REQUIRE(grid.to_id(int3{-1,-3,1}) == 1);
+  REQUIRE(!grid.contains(int3{5,0,1}));
+  REQUIRE(!grid.is_occupied(int3{50,0,1}));
+}
+
+TEST_CASE( "Occupancy grid matches brute force", "[occupancy_grid]" ) {
+  auto bounds = cube<int3>{int3{0,0,0}, int3{150,9,7}};
+  auto grid = occupancy_grid{bounds};
+  std::set<int3> sites, occupied;
+  std::mt19937 gen(3);
+  auto rand_idx = [&] {
+    return int3{std::uniform_int_distribution<>(0,149)(gen),
+                std::uniform_int_distribution<>(0,8)(gen),
+                std::uniform_int_distribution<>(0,6)(gen)};
+  };
+  for (int i = 0; i < 3000; ++i) {
+    auto idx = rand_idx();
+    sites.insert(idx);
+    grid.add_site(idx);
+  }
+  for (int i = 0; i < 20000; ++i) {
+    auto idx = rand_idx();
+    if (i % 3 == 0) {
+      occupied.erase(idx);
+      grid.release(idx);
+    }
+    else {
+      occupied.insert(idx);
+      grid.occupy(idx);
+    }
+    REQUIRE(grid.is_free(idx) == (sites.count(idx) && !occupied.count(idx)));
+
+    auto a = rand_idx(), b = rand_idx();
+    auto block = cube<int3>{a, b + int3{1,1,1}};
+    bool expected = false;
+    traverse(block, 1, [&](int3 const& p) {
+      expected = expected || (sites.count(p) && !occupied.count(p));
+    });
+    REQUIRE(grid.any_free(block) == expected);
+  }
+  REQUIRE(!grid.any_free(cube<int3>{int3{200,0,0}, int3{300,5,5}}));
+}
@@ -0,0 +1,54 @@
+#include "utility/parallel_gzip_stream.hpp"
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <random>
+#include <sstream>
+#include <string>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+namespace io = google::protobuf::io;
+
+namespace {
+  std::string inflate(std::string const& zipped) {
+    io::ArrayInputStream array_stream{zipped.data(), int(zipped.size())};
+    io::GzipInputStream gzip_stream{&array_stream};
+    std::string out;
+    void const* data = nullptr;
+    int size = 0;
+    while (gzip_stream.Next(&data, &size))
+      out.append(static_cast<char const*>(data), size);
+    return out;
+  }
+}
+
+TEST_CASE( "Parallel gzip output reads back with GzipInputStream", "[utility]" ) {
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int> letter('a', 'h');
+  for (std::size_t length : {0, 1, 1000, 1 << 20, 3 * (1 << 20) + 17}) {
+    std::string in(length, '\0');
+    for (auto& c : in)
+      c = char(letter(gen));
+    std::ostringstream out;
+    {
+      //Small blocks, so there are many members and several batches.
+      parallel_gzip_stream gzip_stream{out, 4096};
+      std::size_t pos = 0;
+      void* data = nullptr;
+      int size = 0;
+      while (pos < in.size()) {
+        REQUIRE(gzip_stream.Next(&data, &size));
+        //Hand back part of each buffer, as serializers do.
+        auto n = std::min({std::size_t(size), in.size() - pos, std::size_t(1000)});
+        std::copy(in.begin() + pos, in.begin() + pos + n, static_cast<char*>(data));
+        pos += n;
+        gzip_stream.BackUp(int(size - n));
+      }
+      REQUIRE(gzip_stream.ByteCount() == std::int64_t(in.size()));
+      REQUIRE(gzip_stream.Close());
+    }
+    REQUIRE(inflate(out.str()) == in);
+  }
+}
@@ -0,0 +1,60 @@
+#include "utility/philox.hpp"
+#include <random>
+#include <set>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+TEST_CASE( "Philox matches the Random123 known answers", "[utility]" ) {
+  using c = philox4x32::counter_type;
+  using k = philox4x32::key_type;
+  REQUIRE(philox4x32::generate_block(c{0, 0, 0, 0}, k{0, 0})
+      == (c{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+  REQUIRE(philox4x32::generate_block(c{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                                     k{0xffffffff, 0xffffffff})
+      == (c{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+  REQUIRE(philox4x32::generate_block(c{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                                     k{0xa4093822, 0x299f31d0})
+      == (c{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+
+  //The engine's first outputs are block 0 of stream 0, keyed by the seed.
+  auto gen = philox4x32{0x299f31d0a4093822};
+  auto b = philox4x32::generate_block(c{0, 0, 0, 0}, k{0xa4093822, 0x299f31d0});
+  for (auto w : b)
+    REQUIRE(gen() == w);
+}
+
+TEST_CASE( "Philox discard and substreams", "[utility]" ) {
+  auto a = philox4x32{7}, b = a;
+  for (int skip : {0, 1, 3, 4, 5, 11}) {
+    for (int i = 0; i < skip; ++i)
+      a();
+    b.discard(skip);
+    REQUIRE(a == b);
+    REQUIRE(a() == b());
+  }
+
+  //Substreams depend only on their keys, not on the parent's position.
+  auto root = philox4x32{7};
+  auto s1 = root.substream(3, 1);
+  root.discard(1000);
+  auto s2 = root.substream(3).substream(1);
+  REQUIRE(s1 == s2);
+  REQUIRE(s1() == s2());
+  REQUIRE(philox4x32{7}.substream(3) != philox4x32{8}.substream(3));
+
+  auto firsts = std::set<philox4x32::result_type>{};
+  for (int i = 0; i < 1000; ++i)
+    firsts.insert(philox4x32{7}.substream(i)());
+  REQUIRE(firsts.size() > 995);
+
+  //Usable with the standard distributions.
+  auto gen = philox4x32{9}.substream(2);
+  auto urd = std::uniform_real_distribution<>{};
+  double sum = 0;
+  for (int i = 0; i < 1'000'000; ++i)
+    sum += urd(gen);
+  REQUIRE(std::abs(sum / 1'000'000 - .5) < 1e-3);
+}
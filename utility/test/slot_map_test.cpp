@@ -0,0 +1,56 @@
+#include "utility/slot_map.hpp"
+#include "utility/tagged_int.hpp"
+#include <algorithm>
+#include <string>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+
+namespace {
+  struct test_tag {};
+  using test_id = tagged_int<test_tag>;
+}
+
+TEST_CASE( "Slot map lookups and erasure", "[utility]" ) {
+  auto gen = id_generator<test_tag>{};
+  slot_map<test_id, std::string> sm;
+  REQUIRE(sm.empty());
+  std::vector<test_id> ids;
+  for (int i = 0; i < 100; ++i) {
+    ids.push_back(gen());
+    REQUIRE(sm.insert(std::make_pair(ids.back(), std::to_string(i))).second);
+  }
+  REQUIRE(sm.size() == 100);
+  REQUIRE(sm.at(ids[42]) == "42");
+  //Inserting an existing id leaves its value alone.
+  auto r = sm.insert(std::make_pair(ids[42], std::string{"x"}));
+  REQUIRE(!r.second);
+  REQUIRE(r.first->second == "42");
+
+  for (int i = 0; i < 100; i += 3)
+    REQUIRE(sm.erase(ids[i]) == 1);
+  REQUIRE(sm.erase(ids[0]) == 0);
+  REQUIRE(sm.size() == 66);
+  REQUIRE(sm.count(ids[3]) == 0);
+  REQUIRE(sm.find(ids[3]) == sm.end());
+  REQUIRE(sm.find(ids[4])->second == "4");
+  REQUIRE_THROWS_AS(sm.at(ids[3]), std::out_of_range);
+  REQUIRE_THROWS_AS(sm.at(test_id::invalid()), std::out_of_range);
+  REQUIRE(sm.count(test_id{1000}) == 0);
+
+  //Iteration visits the remaining ids in order.
+  int expected = 1, visited = 0;
+  for (auto const& p : sm) {
+    REQUIRE(p.first.value() == expected);
+    REQUIRE(p.second == std::to_string(expected));
+    expected += expected % 3 == 1 ? 1 : 2;
+    ++visited;
+  }
+  REQUIRE(visited == 66);
+  auto const& csm = sm;
+  auto it = std::find_if(csm.begin(), csm.end(), [](auto const& p) { return p.second == "50"; });
+  REQUIRE(it != csm.end());
+  REQUIRE(it->first == ids[50]);
+}
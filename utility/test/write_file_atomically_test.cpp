@@ -0,0 +1,49 @@
+#include "utility/write_file_atomically.hpp"
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using namespace jhmi;
+namespace fs = boost::filesystem;
+
+TEST_CASE( "Concurrent atomic writes leave one whole file", "[utility]" ) {
+  auto dir = fs::temp_directory_path() / fs::unique_path("atomic_write_%%%%-%%%%");
+  fs::create_directories(dir);
+  auto file = dir / "out.bin";
+  //Each writer's contents are long enough that interleaving would show.
+  //Catch's assertions aren't thread safe, so failures are counted instead.
+  std::atomic<int> failures{0};
+  std::vector<std::thread> writers;
+  for (char c : {'a', 'b', 'c', 'd'}) {
+    writers.emplace_back([=, &failures] {
+      for (int i = 0; i < 20; ++i) {
+        if (!write_file_atomically(file, [&](std::ostream& out) { out << std::string(1 << 16, c); }))
+          ++failures;
+      }
+    });
+  }
+  for (auto& w : writers)
+    w.join();
+  REQUIRE(failures == 0);
+  std::ifstream in{file.string(), std::ios::binary};
+  auto contents = std::string{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+  REQUIRE(contents.size() == std::size_t(1 << 16));
+  REQUIRE(contents == std::string(contents.size(), contents[0]));
+  //No temporaries are left behind.
+  REQUIRE(std::distance(fs::directory_iterator{dir}, fs::directory_iterator{}) == 1);
+
+  REQUIRE(!write_file_atomically(dir / "missing" / "out.bin", [](std::ostream& out) { out << "x"; }));
+  //A writer that fails or throws leaves the earlier file as it was.
+  REQUIRE(!write_file_atomically(file, [](std::ostream& out) { out << "x"; out.setstate(std::ios::badbit); }));
+  REQUIRE_THROWS(write_file_atomically(file, [](std::ostream& out) { out << "x"; throw std::runtime_error("stop"); }));
+  REQUIRE(fs::file_size(file) == std::size_t(1 << 16));
+  REQUIRE(std::distance(fs::directory_iterator{dir}, fs::directory_iterator{}) == 1);
+  fs::remove_all(dir);
+}
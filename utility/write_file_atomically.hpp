@@ -0,0 +1,46 @@
+#ifndef JHMI_UTILITY_WRITE_FILE_ATOMICALLY_HPP_NRC_20261019
+#define JHMI_UTILITY_WRITE_FILE_ATOMICALLY_HPP_NRC_20261019
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+namespace jhmi {
+
+  //Calls write with a stream to a uniquely named file beside filename, then
+  // renames that file over filename.  Readers never see a partly written
+  // file, and concurrent writers can't truncate each other's output.
+  // Returns false, leaving nothing behind, if anything fails; write may
+  // report failure by setting out's badbit.  If write throws, the file is
+  // removed and the exception passed on.
+  template <typename Write>
+  bool write_file_atomically(boost::filesystem::path const& filename, Write write) {
+    boost::system::error_code ec;
+    auto tmp = filename.parent_path()
+      / boost::filesystem::unique_path(filename.filename().string() + ".%%%%-%%%%-%%%%-%%%%.tmp", ec);
+    if (ec)
+      return false;
+    {
+      std::ofstream out{tmp.string(), std::ios::binary};
+      try {
+        write(out);
+      } catch (...) {
+        out.close();
+        boost::filesystem::remove(tmp, ec);
+        throw;
+      }
+      out.close();
+      if (!out) {
+        boost::filesystem::remove(tmp, ec);
+        return false;
+      }
+    }
+    boost::filesystem::rename(tmp, filename, ec);
+    if (ec) {
+      boost::filesystem::remove(tmp, ec);
+      return false;
+    }
+    return true;
+  }
+}
+
+#endif